@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#include "bench.h"
+#include "game.h"
+
+struct Suite {
+    const char *name;
+    BenchFunc  *func;
+};
+
+static const struct Suite suites[] = {
+    { "memory", B_Memory },
+    { "stacks", B_Stacks },
+    { "chunks", B_Chunks },
+    { "broadphase", B_Broadphase },
+    { "sweeps", B_Sweeps },
+    { "jobs", B_Jobs },
+};
+
+/**
+ * Get a monotonic time in nanoseconds
+ */
+u64
+B_Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec;
+}
+
+/**
+ * Make a stack out of plain heap memory, pages only get backed once
+ * they're touched so big ones are cheap
+ */
+struct Stack *
+B_NewStack(size_t size)
+{
+    void *base = malloc(size);
+    if (base == NULL) {
+        fprintf(stderr, "Can't allocate %zu bytes for a stack\n", size);
+        exit(1);
+    }
+    return Z_NewStack(base, size);
+}
+
+/**
+ * Give back a stack from B_NewStack, the header sits at the start of it
+ */
+void
+B_FreeStack(struct Stack *stack)
+{
+    free(stack);
+}
+
+/**
+ * Step an xorshift generator, the same numbers on every run
+ */
+u32
+B_Random(u32 *state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * Get the thread counts to measure scaling at, doubling up to the cores
+ *
+ * @counts : room for MAX_THREADS counts
+ * @return : how many there are
+ */
+u32
+B_ThreadCounts(u32 *counts)
+{
+    u32 cores = MAX(1, MIN(SDL_GetCPUCount(), MAX_THREADS));
+    u32 count = 0;
+    for (u32 threads = 1; threads < cores; threads *= 2)
+        counts[count++] = threads;
+    counts[count++] = cores;
+    return count;
+}
+
+/**
+ * Print a failed check
+ *
+ * @return : ok, so checks can be and-ed together
+ */
+bool
+B_Check(bool ok, const char *what)
+{
+    if (!ok)
+        printf("  FAILED %s\n", what);
+    return ok;
+}
+
+/**
+ * Run every suite, or the ones named on the command line
+ *
+ * Exits with 1 if any check failed, timings are only printed.
+ */
+int
+main(int argc, char *argv[])
+{
+    bool ok = true;
+    for (u32 i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        bool wanted = (argc == 1);
+        for (int arg = 1; arg < argc; arg++)
+            wanted |= (strcmp(argv[arg], suites[i].name) == 0);
+        if (!wanted)
+            continue;
+
+        printf("%s\n", suites[i].name);
+        ok &= suites[i].func();
+    }
+
+    printf("%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
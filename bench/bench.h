@@ -0,0 +1,26 @@
+#ifndef _BENCH_h_
+#define _BENCH_h_
+
+#include <stdio.h>
+
+#include "config.h"
+#include "memory.h"
+
+/* a suite prints its timings and returns false if a check failed */
+typedef bool BenchFunc(void);
+
+u64           B_Now(void);
+struct Stack *B_NewStack(size_t size);
+void          B_FreeStack(struct Stack *stack);
+u32           B_Random(u32 *state);
+u32           B_ThreadCounts(u32 *counts);
+bool          B_Check(bool ok, const char *what);
+
+bool B_Broadphase(void);
+bool B_Chunks(void);
+bool B_Jobs(void);
+bool B_Memory(void);
+bool B_Stacks(void);
+bool B_Sweeps(void);
+
+#endif
@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include "bench.h"
+#include "collide.h"
+
+#define B_BATCHES     (200000)
+#define B_BATCH_MAX   (40)       /* candidates, covers partial steps of every kernel */
+#define B_CANDIDATES  (20000000) /* swept against per timing of a size */
+#define B_DPOS_COUNT  (64)
+
+/**
+ * Get a random coordinate in [-range, range) on a 1/16 grid, so walls
+ * often line up and different candidates get hit at the same t
+ */
+static inline
+r32
+B_Coord(u32 *rng, r32 range)
+{
+    i32 steps = (i32)(range * 16.0f);
+    return (r32)((i32)(B_Random(rng) % (u32)(2 * steps)) - steps) / 16.0f;
+}
+
+/**
+ * Get a random move, some of them too short along an axis to hit anything
+ */
+static
+struct Vec2
+B_Move(u32 *rng)
+{
+    struct Vec2 dpos = { B_Coord(rng, 2.0f), B_Coord(rng, 2.0f) };
+    switch (B_Random(rng) % 8) {
+    case 0: dpos.x = 0.0f; break;
+    case 1: dpos.y = 0.0f; break;
+    case 2: dpos.x = C_SWEEP_MIN * 0.5f; break;
+    }
+    return dpos;
+}
+
+/**
+ * Fill a batch with random boxes, copying some of them to later indices
+ *
+ * @copied : set to the index of the first box that was copied, -1 for none
+ */
+static
+void
+B_FillBatch(struct SweepBatch *batch, u32 count, u32 *rng, i32 *copied)
+{
+    for (u32 i = 0; i < count; i++) {
+        struct Vec2 lo = { B_Coord(rng, 2.0f), B_Coord(rng, 2.0f) };
+        struct Vec2 hi = { lo.x + (r32)(1 + B_Random(rng) % 16) / 16.0f,
+                           lo.y + (r32)(1 + B_Random(rng) % 16) / 16.0f };
+        C_AddCandidate(batch, lo, hi);
+    }
+
+    /* identical boxes are hit at the same t by the same wall, only the *
+     * index can break the tie, and it has to pick the earliest         */
+    *copied = -1;
+    if (count >= 2 && B_Random(rng) % 2 == 0) {
+        u32 from = B_Random(rng) % (count - 1);
+        *copied = (i32)from;
+        for (u32 i = from + 1; i < count; i++) {
+            if (B_Random(rng) % 3 != 0)
+                continue;
+            batch->lo_x[i] = batch->lo_x[from];
+            batch->lo_y[i] = batch->lo_y[from];
+            batch->hi_x[i] = batch->hi_x[from];
+            batch->hi_y[i] = batch->hi_y[from];
+        }
+    }
+}
+
+/**
+ * Sweep random batches through every kernel the cpu runs and check they
+ * all agree with the scalar one to the bit
+ *
+ * @return : false on the first disagreement
+ */
+static
+bool
+B_CheckSweeps(struct Stack *stack, bool *paths)
+{
+    u32 rng = 3;
+    u32 hits = 0;
+    u32 ties = 0;
+
+    for (u32 n = 0; n < B_BATCHES; n++) {
+        struct LocalStack lstack;
+        Z_BeginLocalStack(&lstack, stack);
+
+        struct SweepBatch batch;
+        u32 count = B_Random(&rng) % (B_BATCH_MAX + 1);
+        i32 copied;
+        C_BeginBatch(&batch, count, stack);
+        B_FillBatch(&batch, count, &rng, &copied);
+        struct Vec2 dpos = B_Move(&rng);
+
+        struct SweepHit want;
+        C_SetSweepPath(SWEEP_SCALAR);
+        C_SweepBatch(&batch, dpos, &want);
+        hits += want.index >= 0;
+
+        /* a later copy of a box must never win over the box itself */
+        if (copied >= 0 && want.index > copied) {
+            u32 i = (u32)want.index;
+            if (batch.lo_x[i] == batch.lo_x[copied] && batch.lo_y[i] == batch.lo_y[copied] &&
+                batch.hi_x[i] == batch.hi_x[copied] && batch.hi_y[i] == batch.hi_y[copied]) {
+                printf("  batch %u: copy %d won over candidate %d\n", n, want.index, copied);
+                Z_EndLocalStack(&lstack);
+                return false;
+            }
+        }
+        ties += copied >= 0 && want.index == copied;
+
+        for (int path = SWEEP_SCALAR + 1; path < SweepPath_COUNT; path++) {
+            if (!paths[path])
+                continue;
+
+            struct SweepHit got;
+            C_SetSweepPath(path);
+            C_SweepBatch(&batch, dpos, &got);
+            if (memcmp(&got.t, &want.t, sizeof(r32)) != 0 || got.index != want.index ||
+                memcmp(&got.normal, &want.normal, sizeof(struct Vec2)) != 0) {
+                printf("  batch %u, %u candidates: %s hit %d at %a, scalar hit %d at %a\n", n, count,
+                       C_SweepPathName(path), got.index, got.t, want.index, want.t);
+                Z_EndLocalStack(&lstack);
+                return false;
+            }
+        }
+
+        Z_EndLocalStack(&lstack);
+    }
+
+    printf("  %u batches, %u hit something, %u decided between identical boxes\n", B_BATCHES, hits, ties);
+    return true;
+}
+
+/**
+ * Time a kernel on a batch of count candidates
+ *
+ * @return : nanoseconds per candidate
+ */
+static
+r64
+B_TimeSweep(struct Stack *stack, enum SweepPath path, u32 count)
+{
+    struct LocalStack lstack;
+    Z_BeginLocalStack(&lstack, stack);
+
+    u32 rng = count;
+    i32 copied;
+    struct SweepBatch batch;
+    C_BeginBatch(&batch, count, stack);
+    B_FillBatch(&batch, count, &rng, &copied);
+
+    struct Vec2 dpos[B_DPOS_COUNT];
+    for (u32 i = 0; i < B_DPOS_COUNT; i++)
+        dpos[i] = B_Move(&rng);
+
+    C_SetSweepPath(path);
+    u32 sweeps = B_CANDIDATES / count;
+    volatile r32 sink = 0.0f;
+    u64 start = B_Now();
+    for (u32 i = 0; i < sweeps; i++) {
+        struct SweepHit hit;
+        C_SweepBatch(&batch, dpos[i % B_DPOS_COUNT], &hit);
+        sink += hit.t;
+    }
+    u64 elapsed = B_Now() - start;
+
+    Z_EndLocalStack(&lstack);
+    return (r64)elapsed / ((r64)sweeps * count);
+}
+
+/**
+ * Check the wide sweep kernels against the scalar one and time them all
+ */
+bool
+B_Sweeps(void)
+{
+    struct Stack *stack = B_NewStack(MEGABYTES(16));
+    enum SweepPath chosen = C_SweepPath();
+
+    bool paths[SweepPath_COUNT];
+    printf("  kernels:");
+    for (int path = 0; path < SweepPath_COUNT; path++) {
+        paths[path] = C_SetSweepPath(path);
+        printf(" %s%s", C_SweepPathName(path), paths[path] ? "" : " (can't run)");
+    }
+    printf("\n");
+
+    bool ok = B_Check(B_CheckSweeps(stack, paths), "every kernel matches the scalar one");
+
+    static const u32 counts[] = { 8, 64, 1024 };
+    for (u32 c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        printf("  %5u candidates ", counts[c]);
+        for (int path = 0; path < SweepPath_COUNT; path++)
+            if (paths[path])
+                printf("  %s %6.2f ns", C_SweepPathName(path), B_TimeSweep(stack, path, counts[c]));
+        printf("  a candidate\n");
+    }
+
+    C_SetSweepPath(chosen);
+    B_FreeStack(stack);
+    return ok;
+}
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "entity.h"
+#include "query.h"
+#include "world.h"
+
+#define B_MOVES      (100000) /* npc moves per timing of a size */
+#define B_NPC_RAD    (0.02f)  /* small enough that 10k still fit in a chunk */
+#define B_QUERY_GROW (0.1f)   /* about as far as Move's swept query reaches */
+
+/**
+ * Make a world with one empty chunk holding count wandering npcs
+ */
+static
+struct WorldState *
+B_NewCrowd(u32 count, struct WorldChunk **out)
+{
+    struct WorldState *world = calloc(1, sizeof(*world));
+    W_InitWorld(world, B_NewStack(MEGABYTES(256)));
+
+    /* not generated, so there are no walls or npcs of its own */
+    struct WorldChunk *chunk = W_GetChunk(world, 6, 6, true);
+    u32 rng = count;
+    for (u32 i = 0; i < count; i++) {
+        struct EntityRow npc = {
+            .pos    = { 0.5f + (r32)(B_Random(&rng) % 1000) / 100.0f,
+                        0.5f + (r32)(B_Random(&rng) % 1000) / 100.0f },
+            .rad    = { B_NPC_RAD, B_NPC_RAD },
+            .wander = B_Random(&rng) | 1,
+        };
+        E_AddEntity(world, chunk, ARCH_NPC, &npc);
+    }
+
+    *out = chunk;
+    return world;
+}
+
+static
+void
+B_FreeCrowd(struct WorldState *world)
+{
+    B_FreeStack(world->stack);
+    free(world);
+}
+
+/**
+ * Check a chunk's sweep list is sorted and every entry is the one its
+ * slot points at
+ */
+static
+bool
+B_CheckSweep(struct WorldState *world, struct WorldChunk *chunk)
+{
+    struct SweepList *list = &chunk->sweep;
+    bool ok = list->count == world->entity_count;
+    for (u32 i = 0; i < list->count && ok; i++) {
+        struct SweepEntry *entry = &list->entries[i];
+        struct EntitySlot *slot = &world->slots[entry->id];
+        struct EntityTable *table = &chunk->tables[slot->arch];
+        ok &= slot->sweep == i && slot->chunk == chunk;
+        ok &= i == 0 || list->entries[i - 1].lo <= entry->lo;
+        ok &= entry->lo == table->pos[slot->row].x - table->rad[slot->row].x;
+    }
+    return ok;
+}
+
+/**
+ * Query a box around every npc through the sweep list, then again by
+ * testing every npc in the chunk, and check both find as many
+ *
+ * @brute  : set to the nanoseconds per query of the plain scan
+ * @return : nanoseconds per query through the sweep list, 0 on a mismatch
+ */
+static
+r64
+B_TimeQueries(struct WorldState *world, struct WorldChunk *chunk, struct Stack *scratch, r64 *brute)
+{
+    struct EntityTable *table = &chunk->tables[ARCH_NPC];
+    u32 count = table->count;
+    u32 *found = calloc(count, sizeof(u32));
+    struct Vec2 grow = { B_QUERY_GROW, B_QUERY_GROW };
+
+    u64 start = B_Now();
+    for (u32 i = 0; i < count; i++) {
+        struct Vec2 lo = V2_Sub(V2_Sub(table->pos[i], table->rad[i]), grow);
+        struct Vec2 hi = V2_Add(V2_Add(table->pos[i], table->rad[i]), grow);
+
+        struct LocalStack lstack;
+        Z_BeginLocalStack(&lstack, scratch);
+        struct QueryHits hits;
+        Q_Box(world, chunk, lo, hi, 0, scratch, &hits);
+        found[i] = hits.count;
+        Z_EndLocalStack(&lstack);
+    }
+    r64 sweep = (r64)(B_Now() - start) / count;
+
+    /* the same overlap test Q_Box makes, against everyone */
+    start = B_Now();
+    bool ok = true;
+    for (u32 i = 0; i < count; i++) {
+        struct Vec2 lo = V2_Sub(V2_Sub(table->pos[i], table->rad[i]), grow);
+        struct Vec2 hi = V2_Add(V2_Add(table->pos[i], table->rad[i]), grow);
+        u32 hits = 0;
+        for (u32 j = 0; j < count; j++) {
+            struct Vec2 pos = table->pos[j];
+            struct Vec2 rad = table->rad[j];
+            hits += pos.x - rad.x <= hi.x && pos.x + rad.x >= lo.x &&
+                    pos.y - rad.y <= hi.y && pos.y + rad.y >= lo.y;
+        }
+        ok &= hits == found[i];
+    }
+    *brute = (r64)(B_Now() - start) / count;
+
+    free(found);
+    return ok ? sweep : 0.0;
+}
+
+/**
+ * Time W_UpdateEntities and box queries with count npcs in one chunk
+ *
+ * @return : false if the sweep list or a query went wrong
+ */
+static
+bool
+B_TimeCrowd(u32 count, struct Stack *scratch)
+{
+    struct WorldChunk *chunk;
+    struct WorldState *world = B_NewCrowd(count, &chunk);
+    u32 ticks = MAX(B_MOVES / count, 10);
+    u64 awake = 0;
+
+    u64 start = B_Now();
+    for (u32 t = 0; t < ticks; t++) {
+        W_UpdateEntities(world);
+        awake += chunk->active.count;
+    }
+    r64 tick = (r64)(B_Now() - start) / ticks;
+
+    bool ok = B_Check(B_CheckSweep(world, chunk), "the sweep list is sorted and matches the slots");
+
+    r64 brute;
+    r64 query = B_TimeQueries(world, chunk, scratch, &brute);
+    ok &= B_Check(query > 0.0, "box queries find the same npcs as testing all of them");
+
+    printf("  %6u npcs  %9.3f ms a tick, %5.1f%% awake  box query %8.1f ns, testing all %10.1f ns\n",
+           count, tick / 1e6, 100.0 * (r64)awake / ((r64)ticks * count), query, brute);
+
+    B_FreeCrowd(world);
+    return ok;
+}
+
+/**
+ * Time the broadphase with 100, 1k and 10k npcs crowded into one chunk
+ */
+bool
+B_Broadphase(void)
+{
+    struct Stack *scratch = B_NewStack(MEGABYTES(64));
+    Z_BindScratchStack(scratch);
+
+    bool ok = true;
+    for (u32 count = 100; count <= 10000; count *= 10)
+        ok &= B_TimeCrowd(count, scratch);
+
+    Z_BindScratchStack(NULL);
+    B_FreeStack(scratch);
+    return ok;
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "entity.h"
+#include "game.h"
+#include "job.h"
+#include "world.h"
+
+#define B_SIDE    (24)  /* chunks along each side, so every phase has 64 */
+#define B_NPCS    (64)  /* per chunk */
+#define B_TICKS   (50)
+#define B_SCRATCH MEGABYTES(16)
+
+/**
+ * Make a world of B_SIDE by B_SIDE empty chunks with B_NPCS npcs each,
+ * the same every time
+ */
+static
+struct WorldState *
+B_NewTown(void)
+{
+    struct WorldState *world = calloc(1, sizeof(*world));
+    W_InitWorld(world, B_NewStack(GIGABYTES(1ull)));
+
+    u32 rng = 11;
+    for (u32 y = 1; y <= B_SIDE; y++) {
+        for (u32 x = 1; x <= B_SIDE; x++) {
+            struct WorldChunk *chunk = W_GetChunk(world, x, y, true);
+            for (u32 n = 0; n < B_NPCS; n++) {
+                struct EntityRow npc = {
+                    .pos    = { 0.5f + (r32)(B_Random(&rng) % 1000) / 100.0f,
+                                0.5f + (r32)(B_Random(&rng) % 1000) / 100.0f },
+                    .rad    = { 0.35f, 0.2f },
+                    .wander = B_Random(&rng) | 1,
+                };
+                E_AddEntity(world, chunk, ARCH_NPC, &npc);
+            }
+        }
+    }
+    return world;
+}
+
+/**
+ * Time W_UpdateEntities over the same world at 1 up to as many threads as
+ * there are cores, and check every thread count ends up with the same npcs
+ */
+bool
+B_Jobs(void)
+{
+    struct Stack *scratch[J_MAX_THREADS];
+    for (u32 i = 0; i < J_MAX_THREADS; i++)
+        scratch[i] = B_NewStack(B_SCRATCH);
+    Z_BindScratchStack(scratch[0]);
+
+    u32 counts[MAX_THREADS];
+    u32 runs = B_ThreadCounts(counts);
+    r64 serial = 0.0;
+    u64 want = 0;
+    bool ok = true;
+
+    printf("  %u chunks of %u npcs, %u ticks\n", B_SIDE * B_SIDE, B_NPCS, B_TICKS);
+    for (u32 run = 0; run < runs; run++) {
+        struct WorldState *world = B_NewTown();
+        J_StartJobs(counts[run], scratch);
+        u32 threads = J_ThreadCount();
+
+        u64 awake = 0;
+        u64 start = B_Now();
+        for (u32 t = 0; t < B_TICKS; t++) {
+            W_UpdateEntities(world);
+            for (u32 i = 0; i < world->table.capacity; i++)
+                if (world->table.slots[i].chunk != NULL)
+                    awake += world->table.slots[i].chunk->active.count;
+        }
+        r64 tick = (r64)(B_Now() - start) / B_TICKS;
+
+        J_StopJobs();
+        u64 hash = E_HashEntities(world);
+        if (run == 0) {
+            serial = tick;
+            want   = hash;
+        }
+        ok &= hash == want;
+
+        printf("  %2u threads  %8.3f ms a tick  %5.2fx  %llu awake a tick  hash %016llx\n",
+               threads, tick / 1e6, serial / tick, (unsigned long long)(awake / B_TICKS),
+               (unsigned long long)hash);
+
+        B_FreeStack(world->stack);
+        free(world);
+    }
+    ok = B_Check(ok, "every thread count moves the npcs the same");
+
+    Z_BindScratchStack(NULL);
+    for (u32 i = 0; i < J_MAX_THREADS; i++)
+        B_FreeStack(scratch[i]);
+    return ok;
+}
@@ -0,0 +1,277 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "bench.h"
+#include "game.h"
+
+#define B_BYTES     (1 << 28)  /* moved per timing of a size */
+#define B_PUSHES    (100000) /* per thread */
+#define B_PUSH_MAX  (32)     /* bytes */
+#define B_ALIGN_MAX (64)
+
+/* the loops Z_ZeroSize and Z_PushCopy_ used before, kept byte at a time *
+ * so the compiler doesn't turn them into memset and memcpy                */
+__attribute__((optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+static
+void
+B_ZeroBytes(void *base, size_t size)
+{
+    char *byte = (char *)base;
+    while (size--)
+        *(byte++) = 0;
+}
+
+__attribute__((optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+static
+void
+B_CopyBytes(void *dest, void *src, size_t size)
+{
+    char *bdest = (char *)dest;
+    char *bsrc  = (char *)src;
+    while (size--)
+        *(bdest++) = *(bsrc++);
+}
+
+/**
+ * Check fills and copies against memset and memcpy at every alignment and
+ * at lengths around the SIMD widths
+ */
+static
+bool
+B_CheckFillCopy(void)
+{
+    static u8 src[4096], dest[4096], want[4096];
+    u32 rng = 1;
+    for (u32 i = 0; i < sizeof(src); i++)
+        src[i] = (u8)B_Random(&rng);
+
+    for (u32 run = 0; run < 20000; run++) {
+        u32 from = B_Random(&rng) % 64;
+        u32 to   = B_Random(&rng) % 64;
+        u32 size = (run < 512) ? run : B_Random(&rng) % 3000;
+        u8 value = (u8)B_Random(&rng);
+        for (u32 i = 0; i < sizeof(dest); i++)
+            dest[i] = want[i] = (u8)(i * 7);
+
+        Z_CopySize(dest + to, src + from, size);
+        memcpy(want + to, src + from, size);
+        if (memcmp(dest, want, sizeof(dest)) != 0)
+            return false;
+
+        Z_FillSize(dest + from, value, size);
+        memset(want + from, value, size);
+        if (memcmp(dest, want, sizeof(dest)) != 0)
+            return false;
+    }
+
+    struct Stack *stack = B_NewStack(KILOBYTES(64));
+    bool ok = true;
+    for (u32 i = 0; i < 200; i++) {
+        Z_PushSize_(stack, B_Random(&rng) % 7, MEM_GENERAL, false);
+        size_t align = 16u << (B_Random(&rng) % 3);
+        ok &= (uptr)Z_PushSizeAligned(stack, 10, align, MEM_GENERAL, true) % align == 0;
+    }
+    B_FreeStack(stack);
+    return ok;
+}
+
+/**
+ * Time zeroing and copying a size over and over
+ *
+ * @return : GB/s
+ */
+static
+r64
+B_TimeMemory(void (*zero)(void *, size_t), void (*copy)(void *, void *, size_t),
+             u8 *dest, u8 *src, size_t size)
+{
+    u64 repeats = MAX(B_BYTES / size, 1);
+    u64 start = B_Now();
+    for (u64 r = 0; r < repeats; r++) {
+        if (copy != NULL)
+            copy(dest, src, size);
+        else
+            zero(dest, size);
+        __asm__ volatile("" : : "r"(dest) : "memory");
+    }
+    return (r64)(repeats * size) / (r64)MAX(B_Now() - start, 1);
+}
+
+/**
+ * Compare the SIMD zero and copy against the byte loops they replaced
+ */
+bool
+B_Memory(void)
+{
+    bool ok = B_Check(B_CheckFillCopy(), "fill and copy match memset and memcpy");
+
+    static const size_t sizes[] = { 64, KILOBYTES(4), KILOBYTES(256), MEGABYTES(16) };
+    u8 *src  = malloc(MEGABYTES(16));
+    u8 *dest = malloc(MEGABYTES(16));
+    memset(src, 1, MEGABYTES(16));
+    memset(dest, 2, MEGABYTES(16));
+
+    printf("  %10s  %14s %14s  %14s %14s\n", "bytes", "zero bytes", "Z_ZeroSize", "copy bytes", "Z_CopySize");
+    for (u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        r64 zero_old = B_TimeMemory(B_ZeroBytes, NULL, dest, src, sizes[i]);
+        r64 zero_new = B_TimeMemory(Z_ZeroSize, NULL, dest, src, sizes[i]);
+        r64 copy_old = B_TimeMemory(NULL, B_CopyBytes, dest, src, sizes[i]);
+        r64 copy_new = B_TimeMemory(NULL, Z_CopySize, dest, src, sizes[i]);
+        printf("  %10zu  %9.2f GB/s %9.2f GB/s  %9.2f GB/s %9.2f GB/s\n",
+               sizes[i], zero_old, zero_new, copy_old, copy_new);
+    }
+
+    free(src);
+    free(dest);
+    return ok;
+}
+
+/* one thread's share of a push stress run */
+struct PushThread {
+    struct Stack *stack;    /* shared by every thread, or its own */
+    u32           id;
+    u8          **pushes;
+    u8           *sizes;
+    u8           *aligns;
+};
+
+/**
+ * Push B_PUSHES blocks of random size and alignment, each filled with a
+ * byte only this thread and push use
+ */
+static
+int
+B_PushThread(void *data)
+{
+    struct PushThread *thread = data;
+    u32 rng = thread->id * 2654435761u + 1;
+    for (u32 i = 0; i < B_PUSHES; i++) {
+        u32 size  = 1 + B_Random(&rng) % B_PUSH_MAX;
+        u32 align = 1u << (B_Random(&rng) % 7);
+        u8 *push  = Z_PushSizeAligned(thread->stack, size, align, MEM_GENERAL, false);
+        thread->pushes[i] = push;
+        thread->sizes[i]  = size;
+        thread->aligns[i] = align;
+        Z_FillSize(push, (u8)(thread->id * 31 + i), size);
+    }
+    return 0;
+}
+
+/**
+ * Check every push of a run landed inside its stack, aligned, and wasn't
+ * written over by another
+ *
+ * @lo : start of the memory the pushes had to come from
+ * @hi : one past its end
+ */
+static
+bool
+B_CheckPushes(struct PushThread *threads, u32 count, u8 *lo, u8 *hi)
+{
+    for (u32 t = 0; t < count; t++) {
+        struct PushThread *thread = &threads[t];
+        for (u32 i = 0; i < B_PUSHES; i++) {
+            u8 *push = thread->pushes[i];
+            if (push < lo || push + thread->sizes[i] > hi || (uptr)push % thread->aligns[i])
+                return false;
+            for (u32 b = 0; b < thread->sizes[i]; b++) {
+                if (push[b] != (u8)(thread->id * 31 + i))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Run the push stress on some threads and time it
+ *
+ * @count  : threads
+ * @shared : all push onto one atomic stack, otherwise each gets a sub stack
+ * @ok     : cleared if a check fails
+ * @return : millions of pushes a second
+ */
+static
+r64
+B_PushRun(u32 count, bool shared, bool *ok)
+{
+    size_t per_thread = (size_t)B_PUSHES * (B_PUSH_MAX + B_ALIGN_MAX) + KILOBYTES(4);
+    struct Stack *master = B_NewStack(per_thread * count + KILOBYTES(64));
+    u8 *lo = (u8 *)master;
+    u8 *hi = lo + per_thread * count + KILOBYTES(64);
+
+    struct PushThread threads[MAX_THREADS];
+    SDL_Thread *handles[MAX_THREADS];
+    Z_SetStackAtomic(master, shared);
+    for (u32 t = 0; t < count; t++) {
+        threads[t] = (struct PushThread){
+            .stack  = shared ? master : Z_NewSubStack(master, per_thread, MEM_GENERAL),
+            .id     = t,
+            .pushes = malloc(B_PUSHES * sizeof(u8 *)),
+            .sizes  = malloc(B_PUSHES),
+            .aligns = malloc(B_PUSHES),
+        };
+    }
+
+    u64 start = B_Now();
+    for (u32 t = 0; t < count; t++)
+        handles[t] = SDL_CreateThread(B_PushThread, "push", &threads[t]);
+    for (u32 t = 0; t < count; t++)
+        SDL_WaitThread(handles[t], NULL);
+    u64 elapsed = B_Now() - start;
+
+    *ok &= B_Check(B_CheckPushes(threads, count, lo, hi), shared ? "atomic pushes" : "sub stack pushes");
+
+    for (u32 t = 0; t < count; t++) {
+        free(threads[t].pushes);
+        free(threads[t].sizes);
+        free(threads[t].aligns);
+    }
+    Z_SetStackAtomic(master, false);
+    B_FreeStack(master);
+    return (r64)count * B_PUSHES * 1e3 / (r64)MAX(elapsed, 1);
+}
+
+/**
+ * Check a push that doesn't fit comes back NULL and leaves the stack alone
+ */
+static
+bool
+B_CheckOverflow(bool atomic)
+{
+    struct Stack *stack = B_NewStack(KILOBYTES(1));
+    Z_SetStackAtomic(stack, atomic);
+    bool ok = Z_PushSize_(stack, 512, MEM_GENERAL, false) != NULL;
+    size_t remaining = Z_RemainingStack(stack);
+    ok &= Z_TryPushSizeAligned(stack, remaining + 1, 1, MEM_GENERAL, false) == NULL;
+    ok &= Z_RemainingStack(stack) == remaining;
+    ok &= Z_TryPushSizeAligned(stack, remaining, 1, MEM_GENERAL, false) != NULL;
+    ok &= Z_TryPushSizeAligned(stack, 1, 1, MEM_GENERAL, false) == NULL;
+    ok &= Z_RemainingStack(stack) == 0;
+    Z_SetStackAtomic(stack, false);
+    B_FreeStack(stack);
+    return ok;
+}
+
+/**
+ * Stress pushes from several threads at once, onto one atomic stack and
+ * onto a sub stack per thread, and check none of them overlap
+ */
+bool
+B_Stacks(void)
+{
+    bool ok = true;
+    ok &= B_Check(B_CheckOverflow(false), "overflow");
+    ok &= B_Check(B_CheckOverflow(true), "atomic overflow");
+
+    u32 counts[MAX_THREADS];
+    u32 runs = B_ThreadCounts(counts);
+    for (u32 r = 0; r < runs; r++) {
+        r64 atomic = B_PushRun(counts[r], true, &ok);
+        r64 own    = B_PushRun(counts[r], false, &ok);
+        printf("  %2u threads  atomic %7.1f Mpush/s  own stacks %7.1f Mpush/s\n", counts[r], atomic, own);
+    }
+    return ok;
+}
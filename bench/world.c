@@ -0,0 +1,176 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "world.h"
+
+#define B_STRESS_SIDE (512)      /* stress keys come from a square this wide */
+#define B_STRESS_OPS  (2000000)
+#define B_SHUFFLE     (1000003u) /* prime, steps through any power of ten in a scattered order */
+
+/* the table never looks inside a chunk, so every entry shares this one */
+static struct WorldChunk b_chunk;
+
+/**
+ * Make an empty world with only its chunk table set up
+ */
+static
+struct WorldState *
+B_NewWorld(size_t size)
+{
+    struct WorldState *world = calloc(1, sizeof(*world));
+    W_InitWorld(world, B_NewStack(size));
+    return world;
+}
+
+static
+void
+B_FreeWorld(struct WorldState *world)
+{
+    B_FreeStack(world->stack);
+    free(world);
+}
+
+/**
+ * Insert a chunk key the way W_GetChunk does
+ */
+static inline
+void
+B_Insert(struct WorldState *world, u32 x, u32 y)
+{
+    W_TableReserve(world);
+    W_TableInsert(&world->table, (struct ChunkSlot){ x, y, &b_chunk });
+}
+
+/**
+ * Time inserts, hits, misses and erases on a table of count chunks laid
+ * out in a square, like a world that's been explored outwards
+ *
+ * @return : false if a lookup gave the wrong answer
+ */
+static
+bool
+B_TimeTable(u32 count)
+{
+    u32 side = 1;
+    while (side * side < count)
+        side++;
+
+    struct WorldState *world = B_NewWorld((size_t)count * sizeof(struct ChunkSlot) * 4 + MEGABYTES(8));
+    struct ChunkTable *table = &world->table;
+    bool ok = true;
+
+    u64 start = B_Now();
+    for (u32 i = 0; i < count; i++)
+        B_Insert(world, 1 + i % side, 1 + i / side);
+    r64 insert = (r64)(B_Now() - start) / count;
+
+    start = B_Now();
+    u32 found = 0;
+    for (u32 i = 0; i < count; i++) {
+        u32 key = (u32)(((u64)i * B_SHUFFLE) % count);
+        found += W_TableFind(table, 1 + key % side, 1 + key / side) != table->capacity;
+    }
+    r64 hit = (r64)(B_Now() - start) / count;
+    ok &= B_Check(found == count, "every inserted chunk is found");
+
+    start = B_Now();
+    found = 0;
+    for (u32 i = 0; i < count; i++)
+        found += W_TableFind(table, side + 1 + i % side, 1 + i / side) != table->capacity;
+    r64 miss = (r64)(B_Now() - start) / count;
+    ok &= B_Check(found == 0, "missing chunks aren't found");
+
+    struct ChunkTableStats full;
+    W_ChunkTableStats(world, &full);
+
+    /* erase every other key in the scattered order */
+    start = B_Now();
+    for (u32 i = 0; i < count; i += 2) {
+        u32 key = (u32)(((u64)i * B_SHUFFLE) % count);
+        W_TableErase(table, W_TableFind(table, 1 + key % side, 1 + key / side));
+    }
+    r64 erase = (r64)(B_Now() - start) / ((count + 1) / 2);
+
+    found = 0;
+    for (u32 i = 0; i < count; i++) {
+        u32 key = (u32)(((u64)i * B_SHUFFLE) % count);
+        bool present = W_TableFind(table, 1 + key % side, 1 + key / side) != table->capacity;
+        found += (present == (i % 2 == 1));
+    }
+    ok &= B_Check(found == count && table->count == count / 2, "only the erased chunks are gone");
+
+    struct ChunkTableStats half;
+    W_ChunkTableStats(world, &half);
+    printf("  %9u chunks  insert %6.1f ns  hit %6.1f ns  miss %6.1f ns  erase %6.1f ns"
+           "  probe mean %.2f max %u, after erasing half %.2f max %u\n",
+           count, insert, hit, miss, erase, full.mean_probe, full.max_probe, half.mean_probe, half.max_probe);
+
+    B_FreeWorld(world);
+    return ok;
+}
+
+/**
+ * Insert and erase at random against a bitmap of what should be there,
+ * which shakes out backward shift erase leaving an entry unreachable
+ */
+static
+bool
+B_StressTable(void)
+{
+    struct WorldState *world = B_NewWorld(MEGABYTES(64));
+    struct ChunkTable *table = &world->table;
+    u8 *present = calloc(B_STRESS_SIDE * B_STRESS_SIDE, 1);
+    u32 count = 0;
+    u32 rng = 7;
+    bool ok = true;
+
+    for (u32 op = 0; op < B_STRESS_OPS && ok; op++) {
+        /* one draw for both, the next xorshift output depends on this one */
+        u32 draw = B_Random(&rng);
+        u32 key = (draw >> 8) % (B_STRESS_SIDE * B_STRESS_SIDE);
+        u32 x = 1 + key % B_STRESS_SIDE;
+        u32 y = 1 + key / B_STRESS_SIDE;
+        u32 index = W_TableFind(table, x, y);
+        ok &= (index != table->capacity) == present[key];
+
+        /* settles with about half the keys in */
+        bool insert = draw & 1;
+        if (insert && !present[key]) {
+            B_Insert(world, x, y);
+            present[key] = 1;
+            count++;
+        } else if (!insert && present[key]) {
+            W_TableErase(table, index);
+            present[key] = 0;
+            count--;
+        }
+        ok &= table->count == count;
+    }
+
+    for (u32 key = 0; key < B_STRESS_SIDE * B_STRESS_SIDE && ok; key++) {
+        u32 index = W_TableFind(table, 1 + key % B_STRESS_SIDE, 1 + key / B_STRESS_SIDE);
+        ok &= (index != table->capacity) == present[key];
+    }
+
+    struct ChunkTableStats stats;
+    W_ChunkTableStats(world, &stats);
+    printf("  stress %u ops, %u chunks left  probe mean %.2f max %u\n",
+           B_STRESS_OPS, stats.count, stats.mean_probe, stats.max_probe);
+
+    free(present);
+    B_FreeWorld(world);
+    return ok;
+}
+
+/**
+ * Time the chunk table from 10^3 to 10^7 chunks and stress its erase
+ */
+bool
+B_Chunks(void)
+{
+    bool ok = true;
+    for (u32 count = 1000; count <= 10000000; count *= 10)
+        ok &= B_TimeTable(count);
+    ok &= B_Check(B_StressTable(), "random inserts and erases match a bitmap");
+    return ok;
+}
@@ -1,13 +1,125 @@
 #!/bin/python
 import json
+import struct
 import sys
+import zlib
 from os.path import exists
 
+SPRITE_DIR = "./res/sprites/"   # source sheets and the atlas pages written next to them
+ATLAS_SIZE = 1024               # largest atlas page
+ATLAS_PADDING = 2               # transparent pixels kept between frames
+
 def print_usage(msg=None):
     if msg:
         print(msg)
     print("json2h.py [sprite.json]+")
 
+def read_png(filename):
+    """ 8 bit RGB or RGBA, not interlaced, as rows of RGBA bytes """
+    with open(filename, 'rb') as png_file:
+        data = png_file.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise ValueError(filename + " is not a png")
+
+    pos = 8
+    idat = b""
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        if kind == b"IHDR":
+            w, h, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", body)
+        elif kind == b"IDAT":
+            idat += body
+        pos += length + 12
+
+    if depth != 8 or color not in (2, 6) or interlace != 0:
+        raise ValueError(filename + " has to be 8 bit RGB or RGBA without interlacing")
+
+    bpp = 4 if color == 6 else 3
+    stride = w * bpp
+    raw = zlib.decompress(idat)
+    rows = []
+    prev = bytearray(stride)
+    for y in range(h):
+        start = y * (stride + 1)
+        kind = raw[start]
+        row = bytearray(raw[start + 1:start + 1 + stride])
+        for x in range(stride):
+            a = row[x - bpp] if x >= bpp else 0
+            b = prev[x]
+            c = prev[x - bpp] if x >= bpp else 0
+            if kind == 1:
+                row[x] = (row[x] + a) & 0xff
+            elif kind == 2:
+                row[x] = (row[x] + b) & 0xff
+            elif kind == 3:
+                row[x] = (row[x] + (a + b) // 2) & 0xff
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                row[x] = (row[x] + pred) & 0xff
+        prev = row
+
+        if bpp == 3:
+            rgba = bytearray(w * 4)
+            for x in range(w):
+                rgba[x * 4:x * 4 + 3] = row[x * 3:x * 3 + 3]
+                rgba[x * 4 + 3] = 0xff
+            row = rgba
+        rows.append(row)
+
+    return ( w, h, rows )
+
+def write_png(filename, w, h, rows):
+    def chunk(kind, body):
+        return struct.pack(">I", len(body)) + kind + body + \
+               struct.pack(">I", zlib.crc32(kind + body) & 0xffffffff)
+
+    raw = b"".join(b"\x00" + bytes(row) for row in rows)
+    with open(filename, 'wb') as png_file:
+        png_file.write(b"\x89PNG\r\n\x1a\n")
+        png_file.write(chunk(b"IHDR", struct.pack(">IIBBBBB", w, h, 8, 6, 0, 0, 0)))
+        png_file.write(chunk(b"IDAT", zlib.compress(raw, 9)))
+        png_file.write(chunk(b"IEND", b""))
+
+def pack_frames(frames):
+    """ shelves of the tallest frames first, a new page when one fills up, *
+     * returns the page and corner for each frame and the size of each page """
+    order = sorted(range(len(frames)), key=lambda i: (-frames[i]["h"], -frames[i]["w"]))
+    places = [None] * len(frames)
+    pages = []
+    page = -1
+    x = y = shelf = ATLAS_SIZE
+
+    for i in order:
+        w = frames[i]["w"] + ATLAS_PADDING
+        h = frames[i]["h"] + ATLAS_PADDING
+        if w > ATLAS_SIZE or h > ATLAS_SIZE:
+            raise ValueError("frame bigger than an atlas page")
+
+        if x + w > ATLAS_SIZE:
+            x, y, shelf = 0, y + shelf, 0
+        if y + h > ATLAS_SIZE:
+            page, x, y, shelf = page + 1, 0, 0, 0
+            pages.append([0, 0])
+
+        places[i] = ( page, x, y )
+        pages[page][0] = max(pages[page][0], x + w)
+        pages[page][1] = max(pages[page][1], y + h)
+        x += w
+        shelf = max(shelf, h)
+
+    # pages are rounded up to powers of two
+    for size in pages:
+        for d in range(2):
+            p = 1
+            while p < size[d]:
+                p *= 2
+            size[d] = p
+
+    return ( places, pages )
+
 def load_file(filename):
     dest_name = filename[filename.rfind('/') + 1:filename.rfind('.')]
     tags = []
@@ -19,29 +131,64 @@ def load_file(filename):
         for tag in json_info["meta"]["frameTags"]:
             anim = (dest_name + "_" + tag["name"]).upper()
             count = tag["to"] - tag["from"] + 1
-            sgroup = []
 
             for i in range(tag["from"], tag["to"] + 1):
                 frame = json_info["frames"][i]
-                rect = "{ " + \
-                       ".x=" + str(frame["frame"]["x"]) + ", " + \
-                       ".y=" + str(frame["frame"]["y"]) + ", " + \
-                       ".w=" + str(frame["frame"]["w"]) + ", " + \
-                       ".h=" + str(frame["frame"]["h"]) +        \
-                       " }"
-                dt = str(frame["duration"])
-                index = str(i)
-                sgroup.append( "{ " +                                \
-                               ".rect=" + rect + ", " +              \
-                               ".dt=" + dt + ", " +                  \
-                               ".sheet=" + dest_name.upper() + "," + \
-                               ".index=" + index + ", " +            \
-                               ".count=" + str(count) +              \
-                               " }" )
-                tags.append(anim + index)
-            sprites.extend(sgroup)
-
-    return ( dest_name.upper(), tags, sprites )
+                sprites.append({ "sheet": dest_name,
+                                 "x": frame["frame"]["x"], "y": frame["frame"]["y"],
+                                 "w": frame["frame"]["w"], "h": frame["frame"]["h"],
+                                 "dt": frame["duration"], "index": i, "count": count })
+                tags.append(anim + str(i))
+
+    return ( dest_name, tags, sprites )
+
+def build_atlas(all_sprites):
+    """ pack every frame once into atlas pages, written as png next to the *
+     * sheets, and point the sprites at where their frame ended up          """
+    images = {}
+    frames = []
+    lookup = {}
+    for s in all_sprites:
+        key = ( s["sheet"], s["x"], s["y"], s["w"], s["h"] )
+        if key not in lookup:
+            lookup[key] = len(frames)
+            frames.append(s)
+        if s["sheet"] not in images:
+            images[s["sheet"]] = read_png(SPRITE_DIR + s["sheet"] + ".png")
+
+    places, pages = pack_frames(frames)
+
+    atlases = [ [bytearray(w * 4) for y in range(h)] for w, h in pages ]
+    for f, ( page, x, y ) in zip(frames, places):
+        rows = images[f["sheet"]][2]
+        for dy in range(f["h"]):
+            atlases[page][y + dy][x * 4:(x + f["w"]) * 4] = rows[f["y"] + dy][f["x"] * 4:(f["x"] + f["w"]) * 4]
+
+    for p, ( w, h ) in enumerate(pages):
+        write_png(SPRITE_DIR + "atlas" + str(p) + ".png", w, h, atlases[p])
+
+    for s in all_sprites:
+        page, x, y = places[lookup[( s["sheet"], s["x"], s["y"], s["w"], s["h"] )]]
+        s["page"] = page
+        s["x"] = x
+        s["y"] = y
+
+    return len(pages)
+
+def sprite_line(s):
+    rect = "{ " + \
+           ".x=" + str(s["x"]) + ", " + \
+           ".y=" + str(s["y"]) + ", " + \
+           ".w=" + str(s["w"]) + ", " + \
+           ".h=" + str(s["h"]) +        \
+           " }"
+    return "{ " +                                       \
+           ".rect=" + rect + ", " +                     \
+           ".dt=" + str(s["dt"]) + ", " +               \
+           ".sheet=ATLAS" + str(s["page"]) + "," +      \
+           ".index=" + str(s["index"]) + ", " +         \
+           ".count=" + str(s["count"]) +                \
+           " }"
 
 if __name__ == "__main__":
     dest_file = "./src/render_config" # for configuration
@@ -51,7 +198,6 @@ if __name__ == "__main__":
         print_usage("invalid number of arguments")
         exit(0)
 
-    all_sheets = []
     all_tags = []
     all_sprites = []
 
@@ -61,10 +207,11 @@ if __name__ == "__main__":
             exit(0)
 
         sheet, tags, sprites = load_file(sys.argv[i])
-        all_sheets.append(sheet)
         all_tags.extend(tags)
         all_sprites.extend(sprites)
 
+    page_count = build_atlas(all_sprites)
+
     header = []
     source = []
     with open(dest_file + ".h", 'r') as dest:
@@ -75,10 +222,10 @@ if __name__ == "__main__":
                 break
 
         header.append("")
-        header.append("/* all sprite sheets */")
+        header.append("/* atlas pages every sheet was packed into */")
         header.append("enum SpriteSheetId {")
-        for s in all_sheets:
-            header.append("    " + s + ",")
+        for p in range(page_count):
+            header.append("    ATLAS" + str(p) + ",")
         header.append("    SpriteSheet_COUNT")
         header.append("};")
 
@@ -111,6 +258,10 @@ if __name__ == "__main__":
         header.append("/* animations list */")
         header.append("extern struct Animation SPRITES[Anim_COUNT];")
 
+        header.append("")
+        header.append("/* image of each atlas page, relative to the binary */")
+        header.append("extern const char *SHEET_FILES[SpriteSheet_COUNT];")
+
         header.append("")
         header.append("#endif")
         
@@ -118,8 +269,15 @@ if __name__ == "__main__":
         source.append("#include \"" + dest_file.split("/")[-1] + ".h\"")
 
         source.append("struct Animation SPRITES[Anim_COUNT] = {")
-        for s in all_sprites:
-            source.append("    " + s + ("," if s != all_sprites[-1] else ""))
+        for i, s in enumerate(all_sprites):
+            source.append("    " + sprite_line(s) + ("," if i != len(all_sprites) - 1 else ""))
+        source.append("};")
+
+        source.append("")
+        source.append("const char *SHEET_FILES[SpriteSheet_COUNT] = {")
+        for p in range(page_count):
+            source.append("    \"." + SPRITE_DIR + "atlas" + str(p) + ".png\"" + \
+                          ("," if p != page_count - 1 else ""))
         source.append("};")
 
     with open(dest_file + ".h", 'w') as dest:
@@ -0,0 +1,140 @@
+#include "anim.h"
+#include "world.h"
+
+/**
+ * Get the ticks until a frame changes, the frame changes on the first
+ * tick its time goes past its duration
+ *
+ * @duration : ms the frame lasts
+ * @elapsed  : ms already spent on it
+ */
+static inline
+u32
+A_FrameTicks(u32 duration, u32 elapsed)
+{
+    u32 ticks = (elapsed < duration) ? (duration - elapsed) / MS_PER_UPDATE + 1 : 1;
+    return MIN(ticks, A_WHEEL_SPAN - 1);
+}
+
+/**
+ * Put a timer in the bucket of the lowest level that reaches its tick
+ *
+ * @world : the current world
+ * @timer : timer due on or after the wheel's tick
+ */
+static
+void
+A_Insert(struct WorldState *world, struct AnimTimer timer)
+{
+    struct AnimWheel *wheel = &world->anim;
+    u64 delta = timer.due - wheel->tick;
+    u32 level = 0;
+    while (level + 1 < A_WHEEL_LEVELS && delta >= (1ull << (A_WHEEL_BITS * (level + 1))))
+        level++;
+
+    struct AnimBucket *bucket =
+        &wheel->buckets[level][(timer.due >> (A_WHEEL_BITS * level)) & (A_WHEEL_SLOTS - 1)];
+    if (bucket->count == bucket->capacity) {
+        u32 capacity = MAX(bucket->capacity * 2, W_ROWS_MIN);
+        struct AnimTimer *timers = W_AllocColumn(world, capacity * sizeof(struct AnimTimer));
+        if (bucket->timers != NULL) {
+            Z_CopySize(timers, bucket->timers, bucket->count * sizeof(struct AnimTimer));
+            W_FreeColumn(world, bucket->timers, bucket->capacity * sizeof(struct AnimTimer));
+        }
+        bucket->timers   = timers;
+        bucket->capacity = capacity;
+    }
+
+    bucket->timers[bucket->count++] = timer;
+    wheel->count++;
+}
+
+/**
+ * Have an entity's frame changed when its time is up
+ *
+ * @world  : the current world
+ * @handle : entity with a sprite
+ *
+ * Frames that don't animate aren't scheduled. The entity's render_dt is
+ * the time it had already spent on the frame, and is only brought up to
+ * date when the frame changes.
+ */
+void
+A_ScheduleFrame(struct WorldState *world, struct EntityHandle handle)
+{
+    struct EntityRef ref;
+    if (!E_GetEntity(world, handle, &ref))
+        return;
+
+    struct EntityTable *table = E_TABLE(&ref);
+    u32 duration = SPRITES[table->animation[ref.row]].dt;
+    if (table->render_dt == NULL || duration == 1)
+        return;
+
+    u32 ticks = A_FrameTicks(duration, table->render_dt[ref.row]);
+    A_Insert(world, (struct AnimTimer){ handle, world->anim.tick + ticks });
+}
+
+/**
+ * Spread a bucket over the levels below it
+ */
+static
+void
+A_Cascade(struct WorldState *world, struct AnimBucket *bucket)
+{
+    for (u32 i = 0; i < bucket->count; i++) {
+        world->anim.count--;
+        A_Insert(world, bucket->timers[i]);
+    }
+    bucket->count = 0;
+}
+
+/**
+ * Move every loaded entity's animation up to the world's tick
+ *
+ * @world : the current world
+ *
+ * Only the entities whose frame changes on a tick are looked at, each is
+ * moved to its next frame and scheduled again. Higher levels are spread
+ * out first so whatever lands in a lower bucket due now is still seen.
+ */
+void
+A_UpdateAnimations(struct WorldState *world)
+{
+    struct AnimWheel *wheel = &world->anim;
+    wheel->changed = 0;
+
+    while (wheel->tick < world->tick) {
+        u64 tick = ++wheel->tick;
+        for (u32 level = A_WHEEL_LEVELS; level-- > 1;) {
+            if (tick & ((1ull << (A_WHEEL_BITS * level)) - 1))
+                continue;
+            A_Cascade(world, &wheel->buckets[level][(tick >> (A_WHEEL_BITS * level)) & (A_WHEEL_SLOTS - 1)]);
+        }
+
+        /* frames are rescheduled at least a tick on, never into this bucket */
+        struct AnimBucket *bucket = &wheel->buckets[0][tick & (A_WHEEL_SLOTS - 1)];
+        for (u32 i = 0; i < bucket->count; i++) {
+            struct AnimTimer *timer = &bucket->timers[i];
+            struct EntityRef ref;
+            ASSERT(timer->due == tick);
+            if (!E_GetEntity(world, timer->handle, &ref))
+                continue;
+
+            struct EntityTable *table = E_TABLE(&ref);
+            u32 animation = table->animation[ref.row];
+            u32 duration  = SPRITES[animation].dt;
+            u32 index     = SPRITES[animation].index;
+            u32 count     = SPRITES[animation].count;
+
+            table->render_dt[ref.row] += A_FrameTicks(duration, table->render_dt[ref.row]) * MS_PER_UPDATE;
+            table->render_dt[ref.row] -= duration;
+            table->animation[ref.row] = animation + 1 - ((index + 1 == count) ? count : 0);
+            wheel->changed++;
+
+            A_ScheduleFrame(world, timer->handle);
+        }
+        wheel->count -= bucket->count;
+        bucket->count = 0;
+    }
+}
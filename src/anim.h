@@ -0,0 +1,40 @@
+#ifndef _ANIM_h_
+#define _ANIM_h_
+
+struct WorldState;
+
+#include "config.h"
+#include "entity.h"
+
+/* levels of 64 ticks each, so a frame can last up to 2^24 ticks */
+#define A_WHEEL_BITS   (6)
+#define A_WHEEL_SLOTS  (1 << A_WHEEL_BITS)
+#define A_WHEEL_LEVELS (4)
+#define A_WHEEL_SPAN   (1u << (A_WHEEL_BITS * A_WHEEL_LEVELS))
+
+/* an entity's next change of frame */
+struct AnimTimer {
+    struct EntityHandle handle; /* may be stale by the time it's due */
+    u64                 due;    /* tick it's due on */
+};
+
+struct AnimBucket {
+    u32               count;
+    u32               capacity;
+    struct AnimTimer *timers;
+};
+
+/* hierarchical timer wheel, the first level has a bucket per tick and *
+ * each level after it a bucket per 64 ticks of the one below, a      *
+ * bucket is spread over the level below once its ticks come round    */
+struct AnimWheel {
+    u64 tick;           /* last tick advanced to */
+    u32 count;          /* timers in the wheel */
+    u32 changed;        /* frames changed last update */
+    struct AnimBucket buckets[A_WHEEL_LEVELS][A_WHEEL_SLOTS];
+};
+
+void A_ScheduleFrame(struct WorldState *world, struct EntityHandle handle);
+void A_UpdateAnimations(struct WorldState *world);
+
+#endif
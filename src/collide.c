@@ -0,0 +1,475 @@
+#include <SDL2/SDL.h>
+
+#include "collide.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define C_SSE
+#if defined(__GNUC__)
+#define C_AVX2 /* built per function, the rest of the game needn't be */
+#endif
+#endif
+
+/* padding, far enough that no move can reach it */
+#define C_SWEEP_PAD (1e30f)
+
+/* earliest hit found by a kernel, before the epsilon is taken off */
+struct SweepBest {
+    r32 t;
+    i32 index;
+    i32 wall;  /* 0 top, 1 bottom, 2 left, 3 right */
+};
+
+typedef void SweepKernel(struct SweepBatch *batch, struct Vec2 dpos, struct SweepBest *best);
+
+static const struct Vec2 C_NORMALS[4] = {
+    {  0.0f, -1.0f },
+    {  0.0f,  1.0f },
+    { -1.0f,  0.0f },
+    {  1.0f,  0.0f },
+};
+
+/**
+ * Sweep against every candidate one at a time, what the wider kernels are
+ * checked against
+ *
+ * @batch : the candidates
+ * @dpos  : how far the point moves
+ * @best  : filled in with the earliest hit
+ *
+ * A wall is hit at t when 0 < t < 1 and the point is strictly between the
+ * wall's ends. The earliest t wins, ties go to the first candidate and
+ * then the first wall, so the order the walls are tested in doesn't
+ * change the result and the wide kernels can test them side by side.
+ */
+static
+void
+C_SweepScalar(struct SweepBatch *batch, struct Vec2 dpos, struct SweepBest *best)
+{
+    bool along_y = fabsf(dpos.y) > C_SWEEP_MIN;
+    bool along_x = fabsf(dpos.x) > C_SWEEP_MIN;
+
+    for (u32 i = 0; i < batch->count; i++) {
+        /* plane, ends of the wall, then the move along and across it */
+        struct {
+            r32 plane, lo, hi, d, e;
+            bool used;
+        } walls[4] = {{ batch->lo_y[i], batch->lo_x[i], batch->hi_x[i], dpos.y, dpos.x, along_y },
+                      { batch->hi_y[i], batch->lo_x[i], batch->hi_x[i], dpos.y, dpos.x, along_y },
+                      { batch->lo_x[i], batch->lo_y[i], batch->hi_y[i], dpos.x, dpos.y, along_x },
+                      { batch->hi_x[i], batch->lo_y[i], batch->hi_y[i], dpos.x, dpos.y, along_x }};
+
+        for (int wall = 0; wall < 4; wall++) {
+            if (!walls[wall].used)
+                continue;
+
+            r32 t = walls[wall].plane / walls[wall].d;
+            r32 s = t * walls[wall].e;
+            if (t > 0.0f && t < best->t && walls[wall].lo < s && s < walls[wall].hi) {
+                best->t     = t;
+                best->index = i;
+                best->wall  = wall;
+            }
+        }
+    }
+}
+
+#if defined(C_SSE)
+/**
+ * Test one wall of four candidates, keeping each lane's earliest hit
+ *
+ * @plane  : where the walls are along the move
+ * @d      : move towards the walls
+ * @e      : move along the walls
+ * @lo     : start of the walls
+ * @hi     : end of the walls
+ * @index  : candidate in each lane
+ * @wall   : which wall this is
+ * @best_* : each lane's earliest hit so far
+ */
+static inline
+void
+C_WallSSE(__m128 plane, __m128 d, __m128 e, __m128 lo, __m128 hi, __m128 index, __m128 wall,
+          __m128 *best_t, __m128 *best_i, __m128 *best_w)
+{
+    __m128 t = _mm_div_ps(plane, d);
+    __m128 s = _mm_mul_ps(t, e);
+    __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(t, _mm_setzero_ps()), _mm_cmplt_ps(t, *best_t)),
+                            _mm_and_ps(_mm_cmplt_ps(lo, s), _mm_cmplt_ps(s, hi)));
+
+    *best_t = _mm_or_ps(_mm_and_ps(hit, t),     _mm_andnot_ps(hit, *best_t));
+    *best_i = _mm_or_ps(_mm_and_ps(hit, index), _mm_andnot_ps(hit, *best_i));
+    *best_w = _mm_or_ps(_mm_and_ps(hit, wall),  _mm_andnot_ps(hit, *best_w));
+}
+
+/**
+ * Sweep against four candidates at a time
+ *
+ * @batch : the candidates, padded to a multiple of four
+ * @dpos  : how far the point moves
+ * @best  : filled in with the earliest hit, same as C_SweepScalar's
+ *
+ * Each lane sees its candidates in order, so only ties between lanes are
+ * left to settle by candidate at the end. Candidate numbers are kept as
+ * floats, exact for far more candidates than a batch ever holds.
+ */
+static
+void
+C_SweepSSE(struct SweepBatch *batch, struct Vec2 dpos, struct SweepBest *best)
+{
+    bool along_y = fabsf(dpos.y) > C_SWEEP_MIN;
+    bool along_x = fabsf(dpos.x) > C_SWEEP_MIN;
+
+    __m128 dx = _mm_set1_ps(dpos.x);
+    __m128 dy = _mm_set1_ps(dpos.y);
+    __m128 best_t = _mm_set1_ps(best->t);
+    __m128 best_i = _mm_set1_ps(-1.0f);
+    __m128 best_w = _mm_setzero_ps();
+    __m128 lanes  = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+    for (u32 i = 0; i < batch->count; i += 4) {
+        __m128 lo_x  = _mm_load_ps(batch->lo_x + i);
+        __m128 lo_y  = _mm_load_ps(batch->lo_y + i);
+        __m128 hi_x  = _mm_load_ps(batch->hi_x + i);
+        __m128 hi_y  = _mm_load_ps(batch->hi_y + i);
+        __m128 index = _mm_add_ps(_mm_set1_ps((r32)i), lanes);
+
+        if (along_y) {
+            C_WallSSE(lo_y, dy, dx, lo_x, hi_x, index, _mm_set1_ps(0.0f), &best_t, &best_i, &best_w);
+            C_WallSSE(hi_y, dy, dx, lo_x, hi_x, index, _mm_set1_ps(1.0f), &best_t, &best_i, &best_w);
+        }
+        if (along_x) {
+            C_WallSSE(lo_x, dx, dy, lo_y, hi_y, index, _mm_set1_ps(2.0f), &best_t, &best_i, &best_w);
+            C_WallSSE(hi_x, dx, dy, lo_y, hi_y, index, _mm_set1_ps(3.0f), &best_t, &best_i, &best_w);
+        }
+    }
+
+    r32 t[4], index[4], wall[4];
+    _mm_storeu_ps(t, best_t);
+    _mm_storeu_ps(index, best_i);
+    _mm_storeu_ps(wall, best_w);
+    for (int lane = 0; lane < 4; lane++) {
+        if (index[lane] < 0.0f)
+            continue;
+        if (t[lane] < best->t || (t[lane] == best->t && (i32)index[lane] < best->index)) {
+            best->t     = t[lane];
+            best->index = (i32)index[lane];
+            best->wall  = (i32)wall[lane];
+        }
+    }
+}
+#endif
+
+#if defined(C_AVX2)
+/**
+ * Test one wall of eight candidates, see C_WallSSE
+ */
+__attribute__((target("avx2")))
+static inline
+void
+C_WallAVX2(__m256 plane, __m256 d, __m256 e, __m256 lo, __m256 hi, __m256 index, __m256 wall,
+           __m256 *best_t, __m256 *best_i, __m256 *best_w)
+{
+    __m256 t = _mm256_div_ps(plane, d);
+    __m256 s = _mm256_mul_ps(t, e);
+    __m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GT_OQ),
+                                             _mm256_cmp_ps(t, *best_t, _CMP_LT_OQ)),
+                               _mm256_and_ps(_mm256_cmp_ps(lo, s, _CMP_LT_OQ),
+                                             _mm256_cmp_ps(s, hi, _CMP_LT_OQ)));
+
+    *best_t = _mm256_blendv_ps(*best_t, t, hit);
+    *best_i = _mm256_blendv_ps(*best_i, index, hit);
+    *best_w = _mm256_blendv_ps(*best_w, wall, hit);
+}
+
+/**
+ * Sweep against eight candidates at a time, see C_SweepSSE
+ *
+ * @batch : the candidates, padded to a multiple of eight
+ * @dpos  : how far the point moves
+ * @best  : filled in with the earliest hit, same as C_SweepScalar's
+ */
+__attribute__((target("avx2")))
+static
+void
+C_SweepAVX2(struct SweepBatch *batch, struct Vec2 dpos, struct SweepBest *best)
+{
+    bool along_y = fabsf(dpos.y) > C_SWEEP_MIN;
+    bool along_x = fabsf(dpos.x) > C_SWEEP_MIN;
+
+    __m256 dx = _mm256_set1_ps(dpos.x);
+    __m256 dy = _mm256_set1_ps(dpos.y);
+    __m256 best_t = _mm256_set1_ps(best->t);
+    __m256 best_i = _mm256_set1_ps(-1.0f);
+    __m256 best_w = _mm256_setzero_ps();
+    __m256 lanes  = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+    for (u32 i = 0; i < batch->count; i += 8) {
+        __m256 lo_x  = _mm256_load_ps(batch->lo_x + i);
+        __m256 lo_y  = _mm256_load_ps(batch->lo_y + i);
+        __m256 hi_x  = _mm256_load_ps(batch->hi_x + i);
+        __m256 hi_y  = _mm256_load_ps(batch->hi_y + i);
+        __m256 index = _mm256_add_ps(_mm256_set1_ps((r32)i), lanes);
+
+        if (along_y) {
+            C_WallAVX2(lo_y, dy, dx, lo_x, hi_x, index, _mm256_set1_ps(0.0f), &best_t, &best_i, &best_w);
+            C_WallAVX2(hi_y, dy, dx, lo_x, hi_x, index, _mm256_set1_ps(1.0f), &best_t, &best_i, &best_w);
+        }
+        if (along_x) {
+            C_WallAVX2(lo_x, dx, dy, lo_y, hi_y, index, _mm256_set1_ps(2.0f), &best_t, &best_i, &best_w);
+            C_WallAVX2(hi_x, dx, dy, lo_y, hi_y, index, _mm256_set1_ps(3.0f), &best_t, &best_i, &best_w);
+        }
+    }
+
+    r32 t[8], index[8], wall[8];
+    _mm256_storeu_ps(t, best_t);
+    _mm256_storeu_ps(index, best_i);
+    _mm256_storeu_ps(wall, best_w);
+    for (int lane = 0; lane < 8; lane++) {
+        if (index[lane] < 0.0f)
+            continue;
+        if (t[lane] < best->t || (t[lane] == best->t && (i32)index[lane] < best->index)) {
+            best->t     = t[lane];
+            best->index = (i32)index[lane];
+            best->wall  = (i32)wall[lane];
+        }
+    }
+}
+#endif
+
+static SweepKernel *C_KERNELS[SweepPath_COUNT] = {
+    [SWEEP_SCALAR] = C_SweepScalar,
+#if defined(C_SSE)
+    [SWEEP_SSE]    = C_SweepSSE,
+#endif
+#if defined(C_AVX2)
+    [SWEEP_AVX2]   = C_SweepAVX2,
+#endif
+};
+
+static const char *C_PATH_NAMES[SweepPath_COUNT] = {
+    [SWEEP_SCALAR] = "scalar",
+    [SWEEP_SSE]    = "sse",
+    [SWEEP_AVX2]   = "avx2",
+};
+
+/* picked on first use, a reload of the library picks again */
+static enum SweepPath c_path = SweepPath_COUNT;
+
+/**
+ * Get the kernel sweeps currently go through
+ *
+ * @return : the widest one the cpu supports unless another was set
+ */
+enum SweepPath
+C_SweepPath(void)
+{
+    if (c_path == SweepPath_COUNT) {
+        c_path = SWEEP_SCALAR;
+        if (C_KERNELS[SWEEP_SSE] && SDL_HasSSE2())
+            c_path = SWEEP_SSE;
+        if (C_KERNELS[SWEEP_AVX2] && SDL_HasAVX2())
+            c_path = SWEEP_AVX2;
+    }
+    return c_path;
+}
+
+/**
+ * Force sweeps through a kernel, to compare them
+ *
+ * @path   : the kernel
+ * @return : false if it isn't built or the cpu can't run it
+ */
+bool
+C_SetSweepPath(enum SweepPath path)
+{
+    if (path >= SweepPath_COUNT || C_KERNELS[path] == NULL)
+        return false;
+    if ((path == SWEEP_SSE && !SDL_HasSSE2()) || (path == SWEEP_AVX2 && !SDL_HasAVX2()))
+        return false;
+
+    c_path = path;
+    return true;
+}
+
+/**
+ * Get the name of a kernel
+ *
+ * @path   : the kernel
+ * @return : its name
+ */
+const char *
+C_SweepPathName(enum SweepPath path)
+{
+    return (path < SweepPath_COUNT) ? C_PATH_NAMES[path] : "none";
+}
+
+/**
+ * Start a batch of candidates
+ *
+ * @batch    : the batch
+ * @capacity : most candidates that will be added
+ * @stack    : where the arrays go, freed with the stack
+ */
+void
+C_BeginBatch(struct SweepBatch *batch, u32 capacity, struct Stack *stack)
+{
+    capacity = (MAX(capacity, 1) + C_SWEEP_WIDTH - 1) & ~(C_SWEEP_WIDTH - 1);
+    batch->count    = 0;
+    batch->capacity = capacity;
+    batch->lo_x = Z_PushArrayAligned(stack, r32, capacity, 32, MEM_WORLD, false);
+    batch->lo_y = Z_PushArrayAligned(stack, r32, capacity, 32, MEM_WORLD, false);
+    batch->hi_x = Z_PushArrayAligned(stack, r32, capacity, 32, MEM_WORLD, false);
+    batch->hi_y = Z_PushArrayAligned(stack, r32, capacity, 32, MEM_WORLD, false);
+}
+
+/**
+ * Add a box to a batch
+ *
+ * @batch : the batch
+ * @lo    : min corner, relative to the point being swept
+ * @hi    : max corner
+ */
+void
+C_AddCandidate(struct SweepBatch *batch, struct Vec2 lo, struct Vec2 hi)
+{
+    ASSERT(batch->count < batch->capacity);
+    u32 i = batch->count++;
+    batch->lo_x[i] = lo.x;
+    batch->lo_y[i] = lo.y;
+    batch->hi_x[i] = hi.x;
+    batch->hi_y[i] = hi.y;
+}
+
+/**
+ * Sweep a point against a batch of boxes
+ *
+ * @batch : the candidates
+ * @dpos  : how far the point moves
+ * @hit   : filled in with how far it gets and what stopped it
+ *
+ * Every kernel gives exactly the same result. The move is stopped
+ * C_SWEEP_EPSILON short of the earliest hit so it doesn't end up touching.
+ */
+void
+C_SweepBatch(struct SweepBatch *batch, struct Vec2 dpos, struct SweepHit *hit)
+{
+    /* padding can't be hit, whatever the move */
+    for (u32 i = batch->count; i < batch->capacity; i++) {
+        batch->lo_x[i] = batch->lo_y[i] = C_SWEEP_PAD;
+        batch->hi_x[i] = batch->hi_y[i] = C_SWEEP_PAD;
+    }
+
+    struct SweepBest best = { 1.0f, -1, 0 };
+    C_KERNELS[C_SweepPath()](batch, dpos, &best);
+
+    hit->index  = best.index;
+    hit->t      = 1.0f;
+    hit->normal = (struct Vec2){ 0.0f, 0.0f };
+    if (best.index >= 0) {
+        hit->t      = MAX(0.0f, best.t - C_SWEEP_EPSILON);
+        hit->normal = C_NORMALS[best.wall];
+    }
+}
+
+/**
+ * Start a batch of fixed point candidates
+ *
+ * @batch    : the batch
+ * @capacity : most candidates that will be added
+ * @stack    : where the arrays go, freed with the stack
+ */
+void
+C_BeginFixedBatch(struct FixedBatch *batch, u32 capacity, struct Stack *stack)
+{
+    batch->count    = 0;
+    batch->capacity = MAX(capacity, 1);
+    batch->lo_x = Z_PushArrayAligned(stack, fixed, batch->capacity, _Alignof(fixed), MEM_WORLD, false);
+    batch->lo_y = Z_PushArrayAligned(stack, fixed, batch->capacity, _Alignof(fixed), MEM_WORLD, false);
+    batch->hi_x = Z_PushArrayAligned(stack, fixed, batch->capacity, _Alignof(fixed), MEM_WORLD, false);
+    batch->hi_y = Z_PushArrayAligned(stack, fixed, batch->capacity, _Alignof(fixed), MEM_WORLD, false);
+}
+
+/**
+ * Add a box to a fixed point batch
+ *
+ * @batch : the batch
+ * @lo    : min corner, relative to the point being swept
+ * @hi    : max corner
+ */
+void
+C_AddFixedCandidate(struct FixedBatch *batch, struct FVec2 lo, struct FVec2 hi)
+{
+    ASSERT(batch->count < batch->capacity);
+    u32 i = batch->count++;
+    batch->lo_x[i] = lo.x;
+    batch->lo_y[i] = lo.y;
+    batch->hi_x[i] = hi.x;
+    batch->hi_y[i] = hi.y;
+}
+
+/**
+ * Sweep a point against a batch of boxes in fixed point
+ *
+ * @batch : the candidates
+ * @dpos  : how far the point moves
+ * @hit   : filled in with how far it gets and what stopped it
+ *
+ * Same rules as C_SweepScalar, but t = plane / d is kept as a fraction
+ * and compared by cross multiplying, so every test is exact and only the
+ * final t is rounded.
+ */
+void
+C_SweepFixedBatch(struct FixedBatch *batch, struct FVec2 dpos, struct FixedHit *hit)
+{
+    bool along_y = FX_Abs(dpos.y) > FX_CONST(C_SWEEP_MIN);
+    bool along_x = FX_Abs(dpos.x) > FX_CONST(C_SWEEP_MIN);
+
+    /* earliest hit so far is at best_num / best_den, starting at 1 */
+    i64 best_num   = 1;
+    i64 best_den   = 1;
+    i32 best_index = -1;
+    i32 best_wall  = 0;
+
+    for (u32 i = 0; i < batch->count; i++) {
+        struct {
+            fixed plane, lo, hi, d, e;
+            bool used;
+        } walls[4] = {{ batch->lo_y[i], batch->lo_x[i], batch->hi_x[i], dpos.y, dpos.x, along_y },
+                      { batch->hi_y[i], batch->lo_x[i], batch->hi_x[i], dpos.y, dpos.x, along_y },
+                      { batch->lo_x[i], batch->lo_y[i], batch->hi_y[i], dpos.x, dpos.y, along_x },
+                      { batch->hi_x[i], batch->lo_y[i], batch->hi_y[i], dpos.x, dpos.y, along_x }};
+
+        for (int wall = 0; wall < 4; wall++) {
+            if (!walls[wall].used)
+                continue;
+
+            /* flip so d is positive, which leaves t and s alone, then *
+             * multiply 0 < t < best and lo < s < hi through by d     */
+            i64 plane = walls[wall].plane;
+            i64 d     = walls[wall].d;
+            if (d < 0) {
+                plane = -plane;
+                d     = -d;
+            }
+
+            i64 s = plane * walls[wall].e;
+            if (plane > 0 && plane * best_den < best_num * d &&
+                walls[wall].lo * d < s && s < walls[wall].hi * d) {
+                best_num   = plane;
+                best_den   = d;
+                best_index = i;
+                best_wall  = wall;
+            }
+        }
+    }
+
+    hit->index  = best_index;
+    hit->t      = FX_ONE;
+    hit->normal = (struct FVec2){ 0, 0 };
+    if (best_index >= 0) {
+        fixed t = (fixed)((best_num << FX_SHIFT) / best_den);
+        hit->t      = MAX(0, t - FX_CONST(C_SWEEP_EPSILON));
+        hit->normal = FV2_FromV2(C_NORMALS[best_wall]);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef _COLLIDE_h_
+#define _COLLIDE_h_
+
+#include "config.h"
+#include "math.h"
+#include "memory.h"
+
+#define C_SWEEP_WIDTH   (8)      /* candidates per step of the widest kernel */
+#define C_SWEEP_EPSILON (0.001f) /* how far short of a hit a sweep stops */
+#define C_SWEEP_MIN     (0.001f) /* moves shorter than this along an axis can't hit */
+
+enum SweepPath {
+    SWEEP_SCALAR,
+    SWEEP_SSE,
+    SWEEP_AVX2,
+    SweepPath_COUNT
+};
+
+/* boxes a point is swept against, each an obstacle grown by the mover's  *
+ * radius and relative to the mover's centre, kept as one array per edge *
+ * so several can be tested at once                                      */
+struct SweepBatch {
+    u32  count;
+    u32  capacity;  /* room for padding up to C_SWEEP_WIDTH */
+    r32 *lo_x;
+    r32 *lo_y;
+    r32 *hi_x;
+    r32 *hi_y;
+};
+
+struct SweepHit {
+    r32         t;      /* how far the move gets, 1 when nothing is hit */
+    struct Vec2 normal;
+    i32         index;  /* candidate that was hit, -1 for none */
+};
+
+/* the same in fixed point, for builds with FIXED_POINT */
+struct FixedBatch {
+    u32    count;
+    u32    capacity;
+    fixed *lo_x;
+    fixed *lo_y;
+    fixed *hi_x;
+    fixed *hi_y;
+};
+
+struct FixedHit {
+    fixed        t;
+    struct FVec2 normal;
+    i32          index;
+};
+
+void           C_BeginBatch(struct SweepBatch *batch, u32 capacity, struct Stack *stack);
+void           C_AddCandidate(struct SweepBatch *batch, struct Vec2 lo, struct Vec2 hi);
+void           C_SweepBatch(struct SweepBatch *batch, struct Vec2 dpos, struct SweepHit *hit);
+enum SweepPath C_SweepPath(void);
+bool           C_SetSweepPath(enum SweepPath path);
+const char *   C_SweepPathName(enum SweepPath path);
+void           C_BeginFixedBatch(struct FixedBatch *batch, u32 capacity, struct Stack *stack);
+void           C_AddFixedCandidate(struct FixedBatch *batch, struct FVec2 lo, struct FVec2 hi);
+void           C_SweepFixedBatch(struct FixedBatch *batch, struct FVec2 dpos, struct FixedHit *hit);
+
+#endif
@@ -17,6 +17,7 @@
 #define CONFIG_PROJ_NAME   "proto"
 #define CONFIG_SCRN_WIDTH  1280
 #define CONFIG_SCRN_HEIGHT 720
+#define CONFIG_WORLD_FILE  "../res/world.dat"
 
 /* runs at 120 FPS like this */
 #define MS_PER_UPDATE 8
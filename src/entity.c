@@ -1,97 +1,834 @@
+#include <stddef.h>
+#include <string.h>
+
 #include "entity.h"
 #include "world.h"
+#include "query.h"
+#include "collide.h"
+
+const struct ComponentInfo COMPONENTS[Comp_COUNT] = {
+    [COMP_ID]         = { sizeof(u32),         offsetof(struct EntityRow, id) },
+    [COMP_POS]        = { sizeof(struct Vec2), offsetof(struct EntityRow, pos) },
+    [COMP_VEL]        = { sizeof(struct Vec2), offsetof(struct EntityRow, vel) },
+    [COMP_RAD]        = { sizeof(struct Vec2), offsetof(struct EntityRow, rad) },
+    [COMP_ANIMATION]  = { sizeof(u32),         offsetof(struct EntityRow, animation) },
+    [COMP_RENDER_OFF] = { sizeof(struct Vec2), offsetof(struct EntityRow, render_off) },
+    [COMP_RENDER_DT]  = { sizeof(u32),         offsetof(struct EntityRow, render_dt) },
+    [COMP_WANDER]     = { sizeof(u32),         offsetof(struct EntityRow, wander) },
+};
+
+#define COMP_BODY   (COMP_BIT(COMP_ID) | COMP_BIT(COMP_POS) | COMP_BIT(COMP_VEL) | COMP_BIT(COMP_RAD))
+#define COMP_SPRITE (COMP_BIT(COMP_ANIMATION) | COMP_BIT(COMP_RENDER_OFF) | COMP_BIT(COMP_RENDER_DT))
+
+const u32 ARCHETYPES[Arch_COUNT] = {
+    [ARCH_PLAYER] = COMP_BODY | COMP_SPRITE,
+    [ARCH_NPC]    = COMP_BODY | COMP_SPRITE | COMP_BIT(COMP_WANDER),
+};
 
 /**
- * Move an entity with a specific acceleration.
+ * Make room in a table for a number of rows
+ *
+ * @world : world the columns are allocated from
+ * @table : the table to grow
+ * @arch  : archetype the table holds
+ * @rows  : rows needed
+ *
+ * Capacity doubles, each column is copied into a bigger block and the old
+ * block goes back to the world.
+ */
+static
+void
+E_ReserveRows(struct WorldState *world, struct EntityTable *table, enum Archetype arch, u32 rows)
+{
+    if (rows <= table->capacity)
+        return;
+
+    u32 capacity = MAX(table->capacity, W_ROWS_MIN);
+    while (capacity < rows)
+        capacity *= 2;
+
+    for (int comp = 0; comp < Comp_COUNT; comp++) {
+        if (!(ARCHETYPES[arch] & COMP_BIT(comp)))
+            continue;
+
+        size_t size = COMPONENTS[comp].size;
+        void *column = W_AllocColumn(world, capacity * size);
+        if (table->columns[comp] != NULL) {
+            Z_CopySize(column, table->columns[comp], table->count * size);
+            W_FreeColumn(world, table->columns[comp], table->capacity * size);
+        }
+        table->columns[comp] = column;
+    }
+    table->capacity = capacity;
+}
+
+/**
+ * Give a table's columns back to the world
+ *
+ * @world : world the columns came from
+ * @table : table to empty
+ */
+static
+void
+E_FreeColumns(struct WorldState *world, struct EntityTable *table)
+{
+    for (int comp = 0; comp < Comp_COUNT; comp++) {
+        if (table->columns[comp] != NULL)
+            W_FreeColumn(world, table->columns[comp], table->capacity * COMPONENTS[comp].size);
+        table->columns[comp] = NULL;
+    }
+    world->entity_count -= table->count;
+    table->count    = 0;
+    table->capacity = 0;
+}
+
+/**
+ * Take a handle slot off the free list, growing the slots when empty
+ *
+ * @world  : the current world
+ * @return : index of the slot
+ *
+ * Old slot arrays are left on the world stack, like the chunk table's.
+ */
+static
+u32
+E_NewSlot(struct WorldState *world)
+{
+    if (world->free_slots != 0) {
+        u32 index = world->free_slots - 1;
+        world->free_slots = world->slots[index].row;
+        return index;
+    }
+
+    if (world->slot_count == world->slot_capacity) {
+        u32 capacity = world->slots ? world->slot_capacity * 2 : W_SLOTS_MIN;
+        struct EntitySlot *slots = Z_PushArrayAligned(world->stack, struct EntitySlot, capacity,
+                                                      Z_CACHELINE, MEM_ENTITY, true);
+        if (world->slots)
+            Z_CopySize(slots, world->slots, world->slot_count * sizeof(struct EntitySlot));
+        world->slots         = slots;
+        world->slot_capacity = capacity;
+    }
+
+    u32 index = world->slot_count++;
+    world->slots[index].generation = 1;
+    return index;
+}
+
+/**
+ * Put a slot back on the free list, any handles to it go stale
+ *
+ * @world : the current world
+ * @index : slot to release
+ */
+static
+void
+E_FreeSlot(struct WorldState *world, u32 index)
+{
+    struct EntitySlot *slot = &world->slots[index];
+    slot->generation = MAX(slot->generation + 1, 1);
+    slot->chunk      = NULL;
+    slot->awake      = 0;
+    slot->nav        = 0;
+    slot->row        = world->free_slots;
+    world->free_slots = index + 1;
+}
+
+/**
+ * Slide a sweep list entry along until the list is sorted again
+ *
+ * @world : the current world
+ * @list  : the list
+ * @index : entry whose lo changed
+ *
+ * Equal edges keep their order, so the list only depends on the moves.
+ */
+static
+void
+E_SortSweep(struct WorldState *world, struct SweepList *list, u32 index)
+{
+    struct SweepEntry entry = list->entries[index];
+    while (index > 0 && list->entries[index - 1].lo > entry.lo) {
+        list->entries[index] = list->entries[index - 1];
+        world->slots[list->entries[index].id].sweep = index;
+        index--;
+    }
+    while (index + 1 < list->count && list->entries[index + 1].lo < entry.lo) {
+        list->entries[index] = list->entries[index + 1];
+        world->slots[list->entries[index].id].sweep = index;
+        index++;
+    }
+    list->entries[index] = entry;
+    world->slots[entry.id].sweep = index;
+}
+
+/**
+ * Add an entity to a chunk's sweep list
+ *
+ * @world : the current world
+ * @chunk : chunk the entity is in
+ * @id    : the entity's slot
+ * @pos   : where it is
+ * @rad   : its radius
+ *
+ * Grows like the table columns.
+ */
+static
+void
+E_InsertSweep(struct WorldState *world, struct WorldChunk *chunk, u32 id, struct Vec2 pos, struct Vec2 rad)
+{
+    struct SweepList *list = &chunk->sweep;
+    if (list->count == list->capacity) {
+        u32 capacity = MAX(list->capacity * 2, W_ROWS_MIN);
+        struct SweepEntry *entries = W_AllocColumn(world, capacity * sizeof(struct SweepEntry));
+        if (list->entries != NULL) {
+            Z_CopySize(entries, list->entries, list->count * sizeof(struct SweepEntry));
+            W_FreeColumn(world, list->entries, list->capacity * sizeof(struct SweepEntry));
+        }
+        list->entries  = entries;
+        list->capacity = capacity;
+    }
+
+    u32 index = list->count++;
+    list->entries[index] = (struct SweepEntry){ pos.x - rad.x, pos.x + rad.x, id };
+    list->max_width = MAX(list->max_width, list->entries[index].hi - list->entries[index].lo);
+    E_SortSweep(world, list, index);
+}
+
+/**
+ * Give a chunk's sweep list back to the world
+ *
+ * @world : world the entries came from
+ * @chunk : chunk to empty
+ */
+static
+void
+E_FreeSweep(struct WorldState *world, struct WorldChunk *chunk)
+{
+    struct SweepList *list = &chunk->sweep;
+    if (list->entries != NULL)
+        W_FreeColumn(world, list->entries, list->capacity * sizeof(struct SweepEntry));
+    *list = (struct SweepList){ 0 };
+}
+
+/**
+ * Take an entity out of a chunk's sweep list
+ *
+ * @world : the current world
+ * @chunk : chunk the entity is in
+ * @id    : the entity's slot
+ *
+ * Later entries shift down to keep the order.
+ */
+static
+void
+E_RemoveSweep(struct WorldState *world, struct WorldChunk *chunk, u32 id)
+{
+    struct SweepList *list = &chunk->sweep;
+    u32 index = world->slots[id].sweep;
+    ASSERT(index < list->count && list->entries[index].id == id);
+
+    list->count--;
+    for (u32 i = index; i < list->count; i++) {
+        list->entries[i] = list->entries[i + 1];
+        world->slots[list->entries[i].id].sweep = i;
+    }
+
+    if (list->count == 0)
+        E_FreeSweep(world, chunk);
+}
+
+/**
+ * Bring an entity's sweep list entry up to date after it moved
+ *
+ * @world : the current world
+ * @ref   : the entity
+ */
+static
+void
+E_UpdateSweep(struct WorldState *world, struct EntityRef *ref)
+{
+    struct EntityTable *table = E_TABLE(ref);
+    struct Vec2 pos = table->pos[ref->row];
+    struct Vec2 rad = table->rad[ref->row];
+    u32 index = world->slots[table->id[ref->row]].sweep;
+
+    struct SweepEntry *entry = &ref->chunk->sweep.entries[index];
+    entry->lo = pos.x - rad.x;
+    entry->hi = pos.x + rad.x;
+    E_SortSweep(world, &ref->chunk->sweep, index);
+}
+
+/**
+ * Add an entity to its chunk's active set
+ *
+ * @world : the current world
+ * @chunk : chunk the entity is in
+ * @id    : the entity's slot
+ *
+ * Grows like the table columns.
+ */
+static
+void
+E_InsertActive(struct WorldState *world, struct WorldChunk *chunk, u32 id)
+{
+    struct ActiveSet *set = &chunk->active;
+    if (set->count == set->capacity) {
+        u32 capacity = MAX(set->capacity * 2, W_ROWS_MIN);
+        u32 *ids = W_AllocColumn(world, capacity * sizeof(u32));
+        if (set->ids != NULL) {
+            Z_CopySize(ids, set->ids, set->count * sizeof(u32));
+            W_FreeColumn(world, set->ids, set->capacity * sizeof(u32));
+        }
+        set->ids      = ids;
+        set->capacity = capacity;
+    }
+
+    set->ids[set->count++] = id;
+    world->slots[id].awake = set->count;
+    world->awake_count++;
+}
+
+/**
+ * Give a chunk's active set back to the world
+ *
+ * @world : world the ids came from
+ * @chunk : chunk to empty
+ */
+static
+void
+E_FreeActive(struct WorldState *world, struct WorldChunk *chunk)
+{
+    struct ActiveSet *set = &chunk->active;
+    if (set->ids != NULL)
+        W_FreeColumn(world, set->ids, set->capacity * sizeof(u32));
+    world->awake_count -= set->count;
+    *set = (struct ActiveSet){ 0 };
+}
+
+/**
+ * Take an entity out of its chunk's active set, the last entry moves into
+ * its place
+ *
+ * @world : the current world
+ * @chunk : chunk the entity is in
+ * @id    : the entity's slot
+ */
+static
+void
+E_RemoveActive(struct WorldState *world, struct WorldChunk *chunk, u32 id)
+{
+    struct ActiveSet *set = &chunk->active;
+    u32 index = world->slots[id].awake - 1;
+    ASSERT(index < set->count && set->ids[index] == id);
+
+    u32 last = --set->count;
+    if (index != last) {
+        set->ids[index] = set->ids[last];
+        world->slots[set->ids[index]].awake = index + 1;
+    }
+    world->slots[id].awake = 0;
+    world->awake_count--;
+
+    if (set->count == 0)
+        E_FreeActive(world, chunk);
+}
+
+/**
+ * Append a row to a chunk's table for its archetype
+ *
+ * @world  : the current world
+ * @chunk  : chunk to add to
+ * @arch   : what kind of entity
+ * @init   : components, the id must already name a slot
+ * @return : the new row
+ */
+static
+u32
+E_InsertRow(struct WorldState *world, struct WorldChunk *chunk, enum Archetype arch, struct EntityRow *init)
+{
+    struct EntityTable *table = &chunk->tables[arch];
+    E_ReserveRows(world, table, arch, table->count + 1);
+
+    u32 row = table->count++;
+    for (int comp = 0; comp < Comp_COUNT; comp++) {
+        if (table->columns[comp] == NULL)
+            continue;
+
+        size_t size = COMPONENTS[comp].size;
+        memcpy((u8 *)table->columns[comp] + row * size, (u8 *)init + COMPONENTS[comp].offset, size);
+    }
+
+    struct EntitySlot *slot = &world->slots[init->id];
+    slot->chunk = chunk;
+    slot->arch  = arch;
+    slot->row   = row;
+    E_InsertSweep(world, chunk, init->id, init->pos, init->rad);
+
+    /* everything starts awake, wanderers fall asleep once they stop */
+    slot->awake = 0;
+    if (ARCHETYPES[arch] & COMP_BIT(COMP_WANDER))
+        E_InsertActive(world, chunk, init->id);
+
+    chunk->dirty |= arch != ARCH_PLAYER;
+    world->entity_count++;
+    return row;
+}
+
+/**
+ * Remove a row, the table's last row moves into its place
+ *
+ * @world : the current world
+ * @chunk : chunk holding the row
+ * @arch  : archetype of the table
+ * @row   : row to remove
+ *
+ * The row's slot is left alone, only the moved row's slot is updated.
+ */
+static
+void
+E_DeleteRow(struct WorldState *world, struct WorldChunk *chunk, enum Archetype arch, u32 row)
+{
+    struct EntityTable *table = &chunk->tables[arch];
+    ASSERT(row < table->count);
+    E_RemoveSweep(world, chunk, table->id[row]);
+    if (world->slots[table->id[row]].awake)
+        E_RemoveActive(world, chunk, table->id[row]);
+
+    u32 last = --table->count;
+    if (row != last) {
+        for (int comp = 0; comp < Comp_COUNT; comp++) {
+            if (table->columns[comp] == NULL)
+                continue;
+
+            size_t size = COMPONENTS[comp].size;
+            u8 *column = (u8 *)table->columns[comp];
+            memcpy(column + row * size, column + last * size, size);
+        }
+        world->slots[table->id[row]].row = row;
+    }
+
+    chunk->dirty |= arch != ARCH_PLAYER;
+    world->entity_count--;
+
+    /* empty chunks shouldn't hold on to memory */
+    if (table->count == 0)
+        E_FreeColumns(world, table);
+}
+
+/**
+ * Add an entity to a chunk
+ *
+ * @world  : the current world
+ * @chunk  : chunk to add to
+ * @arch   : what kind of entity
+ * @init   : starting components, NULL to zero them, the id is ignored
+ * @return : handle to the new entity
+ */
+struct EntityHandle
+E_AddEntity(struct WorldState *world, struct WorldChunk *chunk, enum Archetype arch, struct EntityRow *init)
+{
+    struct EntityRow row = { 0 };
+    if (init)
+        row = *init;
+    row.id = E_NewSlot(world);
+
+    E_InsertRow(world, chunk, arch, &row);
+    struct EntityHandle handle = { row.id, world->slots[row.id].generation };
+    A_ScheduleFrame(world, handle);
+    return handle;
+}
+
+/**
+ * Find where an entity lives
+ *
+ * @world  : the current world
+ * @handle : the entity
+ * @ref    : filled in with its chunk, archetype and row
+ * @return : false if the handle is stale
+ */
+bool
+E_GetEntity(struct WorldState *world, struct EntityHandle handle, struct EntityRef *ref)
+{
+    if (handle.index >= world->slot_count)
+        return false;
+
+    struct EntitySlot *slot = &world->slots[handle.index];
+    if (slot->generation != handle.generation || slot->chunk == NULL)
+        return false;
+
+    ref->chunk = slot->chunk;
+    ref->arch  = slot->arch;
+    ref->row   = slot->row;
+    return true;
+}
+
+/**
+ * Remove an entity, stale handles are ignored
+ *
+ * @world  : the current world
+ * @handle : the entity
+ */
+void
+E_RemoveEntity(struct WorldState *world, struct EntityHandle handle)
+{
+    struct EntityRef ref;
+    if (!E_GetEntity(world, handle, &ref))
+        return;
+
+    E_DeleteRow(world, ref.chunk, ref.arch, ref.row);
+    E_FreeSlot(world, handle.index);
+}
+
+/**
+ * Gather every component of an entity
+ *
+ * @table : table holding the entity
+ * @row   : the entity's row
+ * @out   : filled in, components the table doesn't have are zeroed
+ */
+void
+E_GetRow(struct EntityTable *table, u32 row, struct EntityRow *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int comp = 0; comp < Comp_COUNT; comp++) {
+        if (table->columns[comp] == NULL)
+            continue;
+
+        size_t size = COMPONENTS[comp].size;
+        memcpy((u8 *)out + COMPONENTS[comp].offset, (u8 *)table->columns[comp] + row * size, size);
+    }
+}
+
+/**
+ * Release every entity in a chunk, their handles go stale
  *
  * @world : the current world
- * @ent   : entity that's being moved
- * @acc   : the acceleration we move by
+ * @chunk : chunk being removed
+ */
+void
+E_FreeTables(struct WorldState *world, struct WorldChunk *chunk)
+{
+    for (int arch = 0; arch < Arch_COUNT; arch++) {
+        struct EntityTable *table = &chunk->tables[arch];
+        for (u32 row = 0; row < table->count; row++)
+            E_FreeSlot(world, table->id[row]);
+        E_FreeColumns(world, table);
+    }
+    E_FreeSweep(world, chunk);
+    E_FreeActive(world, chunk);
+}
+
+/**
+ * Move an entity into the right chunk after it has moved
  *
- * The entity should know exactly where it is in the world, as well as its
- * world chunk so that it knows what entities to check.
+ * @world  : the current world
+ * @ref    : the entity, updated if it changes chunk
+ * @create : load the chunk moved into if it isn't, otherwise the entity
+ *           is kept inside its current chunk
+ *
+ * Changing chunk swaps the entity out of its old table, so the old table's
+ * last row moves, but the entity keeps its handle.
  */
 void
-Move(struct WorldState *world, struct Entity *ent, struct Vec2 acc)
+E_FixChunk(struct WorldState *world, struct EntityRef *ref, bool create)
 {
-    ent->vel = V2_Add(V2_Mul(0.95f, ent->vel), V2_Mul(SEC_PER_UPDATE, acc));
+    struct EntityTable *table = E_TABLE(ref);
+    struct Vec2 pos = table->pos[ref->row];
+    struct WorldChunk *chunk = W_FixChunkCreate(world, ref->chunk, &pos, create);
+
+    if (chunk == NULL) {
+        /* nowhere to go, stay on this side of the edge */
+        struct Vec2 *old = &table->pos[ref->row];
+        old->x = MIN(MAX(old->x, 0.0f), W_CHUNK_DIM - 0.001f);
+        old->y = MIN(MAX(old->y, 0.0f), W_CHUNK_DIM - 0.001f);
+        table->vel[ref->row] = (struct Vec2){ 0.0f, 0.0f };
+        E_UpdateSweep(world, ref);
+    } else if (chunk != ref->chunk) {
+        struct EntityRow row;
+        E_GetRow(table, ref->row, &row);
+        row.pos = pos;
+
+        /* delete first, the slot still has to point at the old chunk */
+        E_DeleteRow(world, ref->chunk, ref->arch, ref->row);
+        u32 new_row = E_InsertRow(world, chunk, ref->arch, &row);
+        ref->chunk = chunk;
+        ref->row   = new_row;
+    }
+}
+
+/**
+ * Hash every entity's handle, place and motion
+ *
+ * @world  : the current world
+ * @return : the hash, FNV-1a
+ *
+ * Goes by handle slot, so how the rows happen to be laid out doesn't
+ * matter. Two runs that agree on every tick have the same simulation.
+ */
+u64
+E_HashEntities(struct WorldState *world)
+{
+    u64 hash = 0xcbf29ce484222325ull;
+    for (u32 id = 0; id < world->slot_count; id++) {
+        struct EntitySlot *slot = &world->slots[id];
+        if (slot->chunk == NULL)
+            continue;
+
+        struct EntityTable *table = &slot->chunk->tables[slot->arch];
+        struct {
+            u32 id, generation, x, y;
+            struct Vec2 pos, vel;
+        } state = { id, slot->generation, slot->chunk->x, slot->chunk->y,
+                    table->pos[slot->row], table->vel[slot->row] };
+
+        /* each field is 4 bytes, so there's no padding to hash */
+        const u8 *bytes = (const u8 *)&state;
+        for (size_t i = 0; i < sizeof(state); i++)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/**
+ * Put an entity to sleep or wake it up
+ *
+ * @world : the current world
+ * @ref   : the entity
+ * @awake : whether it should be in its chunk's active set
+ *
+ * Only wanderers are ever put in the active set, waking anything else does
+ * nothing.
+ */
+void
+E_SetAwake(struct WorldState *world, struct EntityRef *ref, bool awake)
+{
+    u32 id = E_TABLE(ref)->id[ref->row];
+    if (awake && !world->slots[id].awake && (ARCHETYPES[ref->arch] & COMP_BIT(COMP_WANDER)))
+        E_InsertActive(world, ref->chunk, id);
+    else if (!awake && world->slots[id].awake)
+        E_RemoveActive(world, ref->chunk, id);
+}
+
+/**
+ * Get the handle of an entity a move bumped into
+ *
+ * @world  : the current world
+ * @near   : entities the move was swept against
+ * @self   : where the mover was in them, left out of the candidates
+ * @index  : candidate that was hit
+ * @return : its handle
+ */
+static
+struct EntityHandle
+E_BumpedHandle(struct WorldState *world, struct QueryHits *near, u32 self, u32 index)
+{
+    struct EntityRef *other = &near->hits[index + (index >= self)].ref;
+    u32 id = E_TABLE(other)->id[other->row];
+    return (struct EntityHandle){ id, world->slots[id].generation };
+}
+
+/**
+ * Move in floating point, see Move
+ */
+static
+void
+E_MoveFloat(struct WorldState *world, struct EntityRef *ref, struct Vec2 acc, struct EntityHandle *bumped)
+{
+    struct EntityTable *table = E_TABLE(ref);
+    struct Vec2 pos = table->pos[ref->row];
+    struct Vec2 vel = table->vel[ref->row];
+    struct Vec2 rad = table->rad[ref->row];
+
+    vel = V2_Add(V2_Mul(E_DAMPING, vel), V2_Mul(SEC_PER_UPDATE, acc));
 
     /* don't set the position until after we check collisions */
-    struct Vec2 dpos = V2_Mul(SEC_PER_UPDATE, ent->vel);
+    struct Vec2 dpos = V2_Mul(SEC_PER_UPDATE, vel);
+
+    struct Stack *scratch = Z_ScratchStack();
+    struct LocalStack lstack;
+    Z_BeginLocalStack(&lstack, scratch);
 
     /* actual collision detection and handling */
     r32 tleft = 1.0f;
     for (int z = 0; z < 4 && tleft > 0.0f; z++) {
-        struct Vec2 normal = {0.0f, 0.0f};
-        r32 tmin = 1.0f;
-        /* TODO(david): MUST HANDLE OTHER CHUNKS */
-        for (struct Entity *cmp_ent = ent->chunk->head; cmp_ent != NULL; cmp_ent = cmp_ent->next) {
-            if (cmp_ent == ent)
-                continue;
+        struct QueryHits near;
+        Q_Swept(world, ref->chunk, pos, rad, dpos, 0, scratch, &near);
 
-            /* points with small epsilon for flush collision */
-            r32 points_y[] = { cmp_ent->pos.x - cmp_ent->rad.x - ent->rad.x - ent->pos.x,
-                               cmp_ent->pos.y - cmp_ent->rad.y - ent->rad.y - ent->pos.y,
-                               cmp_ent->pos.x + cmp_ent->rad.x + ent->rad.x - ent->pos.x,
-                               cmp_ent->pos.y + cmp_ent->rad.y + ent->rad.y - ent->pos.y };
-            /* loop over walls defined in this way (top, bottom, left, right) */
-            struct {
-                r32 x0, x1, y, dy, dx;
-                struct Vec2 normal;
-            } walls_y[] = {{ points_y[0], points_y[2], points_y[1], dpos.y, dpos.x, {  0.0f, -1.0f } },
-                           { points_y[0], points_y[2], points_y[3], dpos.y, dpos.x, {  0.0f,  1.0f } },
-                           { points_y[1], points_y[3], points_y[0], dpos.x, dpos.y, { -1.0f,  0.0f } },
-                           { points_y[1], points_y[3], points_y[2], dpos.x, dpos.y, {  1.0f,  0.0f } }};
-
-            for (int walli = 0; walli < 4; walli++) {
-                r32 epsilon = 0.001f;
-                if (fabsf(walls_y[walli].dy) > 0.001f) {
-                    r32 t = walls_y[walli].y / walls_y[walli].dy;
-                    r32 x = t * walls_y[walli].dx;
-                    if (t > 0.0f && walls_y[walli].x0 < x && x < walls_y[walli].x1 && tmin > t) {
-                        tmin = MAX(0.0f, t - epsilon);
-                        normal = walls_y[walli].normal;
-                    }
-                }
-            }
+        /* only the tiles the swept box overlaps can be hit */
+        struct Vec2 end = V2_Add(pos, dpos);
+        struct Vec2 sweep_lo = { MIN(pos.x, end.x) - rad.x, MIN(pos.y, end.y) - rad.y };
+        struct Vec2 sweep_hi = { MAX(pos.x, end.x) + rad.x, MAX(pos.y, end.y) + rad.y };
+        struct QueryTiles tiles;
+        Q_Tiles(world, ref->chunk, sweep_lo, sweep_hi, scratch, &tiles);
+
+        /* entities first, in hit order with ourselves left out, then tiles */
+        struct SweepBatch batch;
+        C_BeginBatch(&batch, near.count + tiles.count, scratch);
 
-            /* points with small epsilon for flush collision */
-            r32 points_z[] = { cmp_ent->pos.x - cmp_ent->tl_point.x - ent->tl_point.w - ent->pos.x,
-                               cmp_ent->pos.y - cmp_ent->tl_point.y - ent->tl_point.h - ent->pos.y,
-                               cmp_ent->pos.x + cmp_ent->br_point.x + ent->br_point.w - ent->pos.x,
-                               cmp_ent->pos.y + cmp_ent->br_point.y + ent->br_point.h - ent->pos.y };
-            /* loop over walls defined in this way (top, bottom, left, right) */
-            struct {
-                r32 x0, x1, y, dy, dx;
-                struct Vec2 normal;
-            } walls_z[] = {{ points_z[0], points_z[2], points_z[1], dpos.y, dpos.x, {  0.0f, -1.0f } },
-                           { points_z[0], points_z[2], points_z[3], dpos.y, dpos.x, {  0.0f,  1.0f } },
-                           { points_z[1], points_z[3], points_z[0], dpos.x, dpos.y, { -1.0f,  0.0f } },
-                           { points_z[1], points_z[3], points_z[2], dpos.x, dpos.y, {  1.0f,  0.0f } }};
-
-            for (int walli = 0; walli < 4; walli++) {
-                if (fabsf(walls_z[walli].dy) > 0.001f) {
-                    r32 t = walls_z[walli].y / walls_z[walli].dy;
-                    r32 x = t * walls_z[walli].dx;
-                    if (t > 0.0f && walls_z[walli].x0 < x && x < walls_z[walli].x1 && tmin > t) {
-                        /* TODO(david): handle a collision */
-                    }
-                }
+        u32 self = near.count;
+        for (u32 i = 0; i < near.count; i++) {
+            struct QueryHit *hit = &near.hits[i];
+            if (hit->ref.chunk == ref->chunk && hit->ref.arch == ref->arch && hit->ref.row == ref->row) {
+                self = i;
+                continue;
             }
+
+            struct Vec2 lo = { hit->pos.x - hit->rad.x - rad.x - pos.x,
+                               hit->pos.y - hit->rad.y - rad.y - pos.y };
+            struct Vec2 hi = { hit->pos.x + hit->rad.x + rad.x - pos.x,
+                               hit->pos.y + hit->rad.y + rad.y - pos.y };
+            C_AddCandidate(&batch, lo, hi);
+        }
+        u32 entities = batch.count;
+
+        for (u32 i = 0; i < tiles.count; i++) {
+            struct QueryTile *tile = &tiles.tiles[i];
+            if (!W_TILES[tile->tile].solid)
+                continue;
+
+            struct Vec2 lo = { tile->x - rad.x - pos.x, tile->y - rad.y - pos.y };
+            struct Vec2 hi = { tile->x + 1 + rad.x - pos.x, tile->y + 1 + rad.y - pos.y };
+            C_AddCandidate(&batch, lo, hi);
         }
 
+        struct SweepHit hit;
+        C_SweepBatch(&batch, dpos, &hit);
+        r32 tmin = hit.t;
+        struct Vec2 normal = hit.normal;
+
+        if (hit.index >= 0 && (u32)hit.index < entities)
+            *bumped = E_BumpedHandle(world, &near, self, hit.index);
+
         /* adjust old pos with some sort of normal */
-        ent->pos = V2_Add(ent->pos, V2_Mul(tmin, dpos));
-        ent->vel = V2_Sub(ent->vel, V2_Mul(V2_Dot(ent->vel, normal), normal));
+        pos = V2_Add(pos, V2_Mul(tmin, dpos));
+        vel = V2_Sub(vel, V2_Mul(V2_Dot(vel, normal), normal));
         dpos = V2_Sub(dpos, V2_Mul(V2_Dot(dpos, normal), normal));
         tleft -= tmin;
     }
 
-    struct WorldChunk *new_chunk = W_FixChunk(world, ent->chunk, &ent->pos);
-    if (new_chunk != ent->chunk) {
-        W_ChunkRemoveEntity(ent->chunk, ent);
-        W_ChunkAddEntity(new_chunk, ent);
-        ent->chunk = new_chunk;
+    table->pos[ref->row] = pos;
+    table->vel[ref->row] = vel;
+    E_UpdateSweep(world, ref);
+
+    Z_EndLocalStack(&lstack);
+}
+
+/**
+ * Move in fixed point, see Move
+ *
+ * Positions and velocities are kept as floats, but on the fixed point
+ * grid where they convert back and forth exactly. Entities are gathered
+ * with a box a little bigger than the sweep so rounding in the float
+ * query can't change which are candidates, the fixed sweep decides.
+ */
+static
+void
+E_MoveFixed(struct WorldState *world, struct EntityRef *ref, struct Vec2 acc, struct EntityHandle *bumped)
+{
+    struct EntityTable *table = E_TABLE(ref);
+    struct FVec2 pos = FV2_FromV2(table->pos[ref->row]);
+    struct FVec2 vel = FV2_FromV2(table->vel[ref->row]);
+    struct FVec2 rad = FV2_FromV2(table->rad[ref->row]);
+
+    vel = FV2_Add(FV2_Mul(FX_CONST(E_DAMPING), vel),
+                  FV2_Mul(FX_CONST(SEC_PER_UPDATE), FV2_FromV2(acc)));
+
+    /* don't set the position until after we check collisions */
+    struct FVec2 dpos = FV2_Mul(FX_CONST(SEC_PER_UPDATE), vel);
+
+    struct Stack *scratch = Z_ScratchStack();
+    struct LocalStack lstack;
+    Z_BeginLocalStack(&lstack, scratch);
+
+    fixed tleft = FX_ONE;
+    for (int z = 0; z < 4 && tleft > 0; z++) {
+        struct FVec2 end = FV2_Add(pos, dpos);
+        struct FVec2 sweep_lo = { MIN(pos.x, end.x) - rad.x, MIN(pos.y, end.y) - rad.y };
+        struct FVec2 sweep_hi = { MAX(pos.x, end.x) + rad.x, MAX(pos.y, end.y) + rad.y };
+
+        struct Vec2 slop = { Q_SWEEP_SLOP, Q_SWEEP_SLOP };
+        struct QueryHits near;
+        Q_Box(world, ref->chunk, V2_Sub(FV2_ToV2(sweep_lo), slop), V2_Add(FV2_ToV2(sweep_hi), slop),
+              0, scratch, &near);
+
+        struct QueryTiles tiles;
+        Q_Tiles(world, ref->chunk, FV2_ToV2(sweep_lo), FV2_ToV2(sweep_hi), scratch, &tiles);
+
+        struct FixedBatch batch;
+        C_BeginFixedBatch(&batch, near.count + tiles.count, scratch);
+
+        u32 self = near.count;
+        for (u32 i = 0; i < near.count; i++) {
+            struct QueryHit *hit = &near.hits[i];
+            if (hit->ref.chunk == ref->chunk && hit->ref.arch == ref->arch && hit->ref.row == ref->row) {
+                self = i;
+                continue;
+            }
+
+            struct FVec2 other = FV2_FromV2(hit->pos);
+            struct FVec2 other_rad = FV2_FromV2(hit->rad);
+            struct FVec2 lo = { other.x - other_rad.x - rad.x - pos.x,
+                                other.y - other_rad.y - rad.y - pos.y };
+            struct FVec2 hi = { other.x + other_rad.x + rad.x - pos.x,
+                                other.y + other_rad.y + rad.y - pos.y };
+            C_AddFixedCandidate(&batch, lo, hi);
+        }
+        u32 entities = batch.count;
+
+        for (u32 i = 0; i < tiles.count; i++) {
+            struct QueryTile *tile = &tiles.tiles[i];
+            if (!W_TILES[tile->tile].solid)
+                continue;
+
+            struct FVec2 lo = { tile->x * FX_ONE - rad.x - pos.x, tile->y * FX_ONE - rad.y - pos.y };
+            struct FVec2 hi = { (tile->x + 1) * FX_ONE + rad.x - pos.x, (tile->y + 1) * FX_ONE + rad.y - pos.y };
+            C_AddFixedCandidate(&batch, lo, hi);
+        }
+
+        struct FixedHit hit;
+        C_SweepFixedBatch(&batch, dpos, &hit);
+
+        if (hit.index >= 0 && (u32)hit.index < entities)
+            *bumped = E_BumpedHandle(world, &near, self, hit.index);
+
+        pos = FV2_Add(pos, FV2_Mul(hit.t, dpos));
+        vel = FV2_Sub(vel, FV2_Mul(FV2_Dot(vel, hit.normal), hit.normal));
+        dpos = FV2_Sub(dpos, FV2_Mul(FV2_Dot(dpos, hit.normal), hit.normal));
+        tleft -= hit.t;
     }
+
+    table->pos[ref->row] = FV2_ToV2(pos);
+    table->vel[ref->row] = FV2_ToV2(vel);
+    E_UpdateSweep(world, ref);
+
+    Z_EndLocalStack(&lstack);
 }
 
+/**
+ * Move an entity with a specific acceleration.
+ *
+ * @world : the current world
+ * @ref    : entity that's being moved
+ * @acc    : the acceleration we move by
+ * @bumped : set to the last entity bumped into, zeroed if there wasn't one
+ *
+ * Collides with entities and tiles in any chunk the move reaches. Only the
+ * position and velocity change, the entity may end up outside its chunk
+ * until E_FixChunk is called. Nothing outside the entity's own chunk is
+ * written, so moves in chunks far enough apart can run side by side.
+ *
+ * Built with FIXED_POINT the move is done in Q16.16, which gives the same
+ * result on any compiler and flags.
+ */
+void
+Move(struct WorldState *world, struct EntityRef *ref, struct Vec2 acc, struct EntityHandle *bumped)
+{
+    *bumped = (struct EntityHandle){ 0, 0 };
+
+#if defined(FIXED_POINT)
+    E_MoveFixed(world, ref, acc, bumped);
+#else
+    E_MoveFloat(world, ref, acc, bumped);
+#endif
+}
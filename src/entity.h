@@ -8,25 +8,132 @@ struct WorldState;
 #include "math.h"
 #include "render_config.h"
 
-struct Entity {
-    struct WorldChunk  *chunk;
+/* kinds of entity, every chunk keeps a table per archetype */
+enum Archetype {
+    ARCH_PLAYER,
+    ARCH_NPC,
+    Arch_COUNT
+};
+
+/* a column of an entity table */
+enum Component {
+    COMP_ID,
+    COMP_POS,
+    COMP_VEL,
+    COMP_RAD,
+    COMP_ANIMATION,
+    COMP_RENDER_OFF,
+    COMP_RENDER_DT,
+    COMP_WANDER,
+    Comp_COUNT
+};
 
-    struct Entity      *prev;
-    struct Entity      *next;
+#define COMP_BIT(comp) (1u << (comp))
 
-    struct Vec2        pos;
-    struct Vec2        vel;
-    struct Vec2        rad; /* floor radius */
+/* every component of one entity, used to pass whole rows around */
+struct EntityRow {
+    u32         id;         /* handle slot, kept up to date by the tables */
+    struct Vec2 pos;
+    struct Vec2 vel;
+    struct Vec2 rad;        /* floor radius */
+    u32         animation;  /* enum AnimationId */
+    struct Vec2 render_off;
+    u32         render_dt;  /* ms spent on the frame when it last changed */
+    u32         wander;     /* rng state deciding where to walk */
+};
+
+/* one archetype's entities in a chunk, each component in its own array  *
+ * indexed by row, columns the archetype doesn't have are left NULL, and *
+ * rows are kept packed by moving the last row into any removed one      */
+struct EntityTable {
+    u32 count;
+    u32 capacity;
 
-    /* offset from pos to top left, then bot right */
-    struct Vec2        tl_point;
-    struct Vec2        br_point;
+    union {
+        void *columns[Comp_COUNT];
+        struct {
+            u32         *id;
+            struct Vec2 *pos;
+            struct Vec2 *vel;
+            struct Vec2 *rad;
+            u32         *animation;
+            struct Vec2 *render_off;
+            u32         *render_dt;
+            u32         *wander;
+        };
+    };
+};
 
-    enum   AnimationId animation;
-    struct Vec2        render_off;
-    u32                render_dt;
+/* stable name for an entity, stale once the entity is removed */
+struct EntityHandle {
+    u32 index;
+    u32 generation; /* never 0, so a zeroed handle is never valid */
 };
 
-void Move(struct WorldState *world, struct Entity *ent, struct Vec2 acc);
+/* where a handle's entity lives, free slots chain through row */
+struct EntitySlot {
+    u32                generation;
+    u32                row;
+    struct WorldChunk *chunk;       /* NULL when free */
+    enum Archetype     arch;
+    u32                sweep;       /* entry in the chunk's sweep list */
+    u32                awake;       /* entry in the chunk's active set + 1, 0 when asleep */
+    u32                nav;         /* agent finding a path + 1, 0 when wandering */
+    u32                draw;        /* place in last frame's draw order, only if that agrees */
+};
+
+/* entities the world moves each tick, by handle slot, in no order, only *
+ * archetypes with COMP_WANDER are kept in it                            */
+struct ActiveSet {
+    u32  count;
+    u32  capacity;
+    u32 *ids;
+};
+
+/* an entity's extent along x, relative to its chunk */
+struct SweepEntry {
+    r32 lo, hi;
+    u32 id;         /* handle slot */
+};
+
+/* every entity in a chunk sorted by the left edge of its box, entities  *
+ * barely move each tick so an insertion sort keeps it in order cheaply */
+struct SweepList {
+    u32 count;
+    u32 capacity;
+    r32 max_width;  /* widest box since the list was last empty */
+    struct SweepEntry *entries;
+};
+
+/* where an entity lives, only good until its table is changed */
+struct EntityRef {
+    struct WorldChunk *chunk;
+    enum Archetype     arch;
+    u32                row;
+};
+
+#define E_TABLE(ref) (&(ref)->chunk->tables[(ref)->arch])
+
+#define E_DAMPING (0.95f) /* velocity kept from one tick to the next */
+
+/* size of each component and where it sits in struct EntityRow */
+struct ComponentInfo {
+    size_t size;
+    size_t offset;
+};
+
+extern const struct ComponentInfo COMPONENTS[Comp_COUNT];
+extern const u32                  ARCHETYPES[Arch_COUNT]; /* COMP_BITs per archetype */
+
+struct EntityHandle E_AddEntity(struct WorldState *world, struct WorldChunk *chunk, enum Archetype arch,
+                                struct EntityRow *init);
+void E_RemoveEntity(struct WorldState *world, struct EntityHandle handle);
+bool E_GetEntity(struct WorldState *world, struct EntityHandle handle, struct EntityRef *ref);
+void E_GetRow(struct EntityTable *table, u32 row, struct EntityRow *out);
+void E_FreeTables(struct WorldState *world, struct WorldChunk *chunk);
+void E_FixChunk(struct WorldState *world, struct EntityRef *ref, bool create);
+void E_SetAwake(struct WorldState *world, struct EntityRef *ref, bool awake);
+u64 E_HashEntities(struct WorldState *world);
+void Move(struct WorldState *world, struct EntityRef *ref, struct Vec2 acc, struct EntityHandle *bumped);
 
 #endif
@@ -7,17 +7,89 @@
 #include "render_config.h"
 #include "world.h"
 #include "entity.h"
+#include "query.h"
+#include "collide.h"
+#include "job.h"
 
 #include "game.h"
 
+/* sprites are batched into one draw call per run of a sheet when SDL can */
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+#define R_GEOMETRY
+#endif
+
 /* Compare macro to make it more legible */
 #define I_COMPARE(input_text, command) (strcmp(input_text + 2, command) == 0)
 
+/**
+ * Print a line of output into the console history
+ *
+ * @state : game state holding the console buffer
+ * @text  : line to print, truncated to fit
+ */
+static
+void
+I_ConsolePrint(struct GameState *state, const char *text)
+{
+    for (int i = 9; i > 1; i--)
+        memcpy(state->buffer[i], state->buffer[i-1], sizeof(state->buffer[i]));
+    snprintf(state->buffer[1], sizeof(state->buffer[1]), "%s", text);
+}
+
+/**
+ * Report how much each stack and each tag within it is using
+ *
+ * @memory  : platform memory, for reserved and committed totals
+ * @state   : game state owning the stacks
+ * @console : print into the console instead of stdout
+ *
+ * Tags that were never allocated from are skipped to keep it short.
+ */
+static
+void
+I_ReportMemory(struct GameMemory *memory, struct GameState *state, bool console)
+{
+    struct {
+        const char *name;
+        struct Stack *stack;
+    } stacks[] = {{ "perm",  state->game_stack },
+                  { "world", state->world->stack },
+                  { "temp",  state->temp_stack }};
+
+    char line[128];
+    snprintf(line, sizeof(line), "committed %lluK of %lluK reserved",
+             (unsigned long long)memory->committed / 1024,
+             (unsigned long long)(memory->perm_memsize + memory->temp_memsize) / 1024);
+    if (console) I_ConsolePrint(state, line);
+    else         printf("%s\n", line);
+
+    for (int i = 0; i < 3; i++) {
+        struct Stack *stack = stacks[i].stack;
+        size_t size = Z_StackSize(stack);
+        snprintf(line, sizeof(line), "%s: %zuK/%zuK peak %zuK", stacks[i].name,
+                 (size - Z_RemainingStack(stack)) / 1024, size / 1024, Z_StackPeak(stack) / 1024);
+        if (console) I_ConsolePrint(state, line);
+        else         printf("%s\n", line);
+
+        for (int tag = 0; tag < MemTag_COUNT; tag++) {
+            struct MemStats stats = Z_TagStats(stack, tag);
+            if (stats.count == 0)
+                continue;
+
+            snprintf(line, sizeof(line), "  %-8s %zuK peak %zuK n %llu", Z_TagName(tag),
+                     stats.bytes / 1024, stats.peak / 1024, (unsigned long long)stats.count);
+            if (console) I_ConsolePrint(state, line);
+            else         printf("%s\n", line);
+        }
+    }
+}
+
 /**
  * Execute a console command that was entered
  *
- * @state : the current game state in case it needs to be manipulated
- * @input : the current state of the input keys
+ * @memory : platform memory, for reporting
+ * @state  : the current game state in case it needs to be manipulated
+ * @input  : the current state of the input keys
  *
  * The current command should still be stored in the input->input_text
  * field. It'll work either way, just come out as empty space. Any
@@ -25,11 +97,18 @@
  */
 static
 void
-I_ExecuteCommand(struct GameState *state, struct GameInput *input)
+I_ExecuteCommand(struct GameMemory *memory, struct GameState *state, struct GameInput *input)
 {
+    bool report_memory = false;
+
     if (I_COMPARE(input->input_text, "reload")) {
+        /* the workers run library code, they can't outlive it */
+        J_StopJobs();
+        W_StopWriter(state->world);
         input->reload_lib = true;
     } else if (I_COMPARE(input->input_text, "restart")) {
+        J_StopJobs();
+        W_StopWriter(state->world);
         input->reload_lib = true;
         state->init = false;
     } else if (I_COMPARE(input->input_text, "quit")) {
@@ -38,6 +117,96 @@ I_ExecuteCommand(struct GameState *state, struct GameInput *input)
         for (int i = 0; i < 10; state->buffer[i++][0] = '\0') /* that's it */;
         input->input_text[2] = '\0';
         input->input_len = 2;
+    } else if (I_COMPARE(input->input_text, "pools")) {
+        struct WorldState *world = state->world;
+        u32 used = 0, capacity = 0;
+        for (int i = 0; i < W_COLUMN_CLASSES; i++) {
+            used     += world->column_pools[i].used;
+            capacity += world->column_pools[i].capacity;
+        }
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "chunks %u/%u ents %u/%u slots awake %u columns %u/%u",
+                                        world->chunk_pool.used, world->chunk_pool.capacity,
+                                        world->entity_count, world->slot_count, world->awake_count,
+                                        used, capacity);
+    } else if (I_COMPARE(input->input_text, "chunks")) {
+        struct ChunkTableStats stats;
+        W_ChunkTableStats(state->world, &stats);
+        struct WorldFile *file = &state->world->file;
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "chunks %u/%u probe mean %.2f max %u file %u/%u",
+                                        stats.count, stats.capacity, stats.mean_probe, stats.max_probe,
+                                        file->base ? file->header->slot_count - file->header->free_count : 0,
+                                        file->base ? file->header->slot_capacity : 0);
+    } else if (I_COMPARE(input->input_text, "sweep")) {
+        /* step through the collision kernels the cpu can run */
+        enum SweepPath path = C_SweepPath();
+        do {
+            path = (path + 1) % SweepPath_COUNT;
+        } while (!C_SetSweepPath(path));
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "sweep kernel %s", C_SweepPathName(path));
+    } else if (I_COMPARE(input->input_text, "jobs")) {
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "jobs %u threads", J_ThreadCount());
+    } else if (I_COMPARE(input->input_text, "follow")) {
+        /* npcs around the player find their way to where it stands */
+        struct WorldState *world = state->world;
+        struct EntityRef player;
+        E_GetEntity(world, state->player, &player);
+        struct Vec2 pos = E_TABLE(&player)->pos[player.row];
+        struct NavPoint goal = { player.chunk->x, player.chunk->y, (u8)pos.x, (u8)pos.y };
+
+        u32 count = 0;
+        for (i32 dy = -1; dy <= 1; dy++) {
+            for (i32 dx = -1; dx <= 1; dx++) {
+                struct WorldChunk *chunk = W_GetChunk(world, player.chunk->x + dx, player.chunk->y + dy, false);
+                if (chunk == NULL)
+                    continue;
+
+                struct EntityTable *table = &chunk->tables[ARCH_NPC];
+                for (u32 row = 0; row < table->count; row++) {
+                    u32 id = table->id[row];
+                    struct EntityRef ref = { chunk, ARCH_NPC, row };
+                    N_RequestPath(world, (struct EntityHandle){ id, world->slots[id].generation }, goal);
+                    E_SetAwake(world, &ref, true);
+                    count++;
+                }
+            }
+        }
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "follow %u npcs", count);
+    } else if (I_COMPARE(input->input_text, "nav")) {
+        struct NavState *nav = &state->world->nav;
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "nav agents %u expanded %u found %u failed %u",
+                                        nav->count, nav->expanded, nav->found, nav->failed);
+    } else if (I_COMPARE(input->input_text, "anim")) {
+        struct AnimWheel *anim = &state->world->anim;
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "anim timers %u changed %u", anim->count, anim->changed);
+    } else if (I_COMPARE(input->input_text, "sort")) {
+        state->draw_incremental = !state->draw_incremental;
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "sort %s", state->draw_incremental ? "incremental" : "radix");
+    } else if (I_COMPARE(input->input_text, "draws")) {
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "draws sprites %u batches %u calls %u bakes %u",
+                                        state->draw_sprites, state->draw_batches, state->draw_calls,
+                                        state->draw_bakes);
+    } else if (I_COMPARE(input->input_text, "wall")) {
+        /* toggle the tile right of the player */
+        struct EntityRef player;
+        E_GetEntity(state->world, state->player, &player);
+        struct Vec2 pos = E_TABLE(&player)->pos[player.row];
+        i32 x = (i32)pos.x + 1;
+        i32 y = (i32)pos.y;
+        u8 tile = W_GetTile(state->world, player.chunk, x, y);
+        W_SetTile(state->world, player.chunk, x, y, (tile == W_TILE_WALL) ? W_TILE_FLOOR : W_TILE_WALL);
+        input->input_len = 2 + snprintf(input->input_text + 2, sizeof(input->input_text) - 2,
+                                        "wall %s at %d,%d", (tile == W_TILE_WALL) ? "off" : "on", x, y);
+    } else if (I_COMPARE(input->input_text, "mem")) {
+        report_memory = true;
     } else if (I_COMPARE(input->input_text, "")) {
         /* do nothing */
     } else { /* text entered was invalid, so say so */
@@ -47,6 +216,9 @@ I_ExecuteCommand(struct GameState *state, struct GameInput *input)
 
     memcpy(state->buffer[1], input->input_text + 2, input->input_len - 1);
 
+    if (report_memory)
+        I_ReportMemory(memory, state, true);
+
     /* cleanup the input text now */
     input->input_entered = false;
     input->input_text[2] = '\0';
@@ -67,38 +239,63 @@ UPDATE(Update) /* memory, input */
     struct GameState *state = (struct GameState *)memory->perm_mem;
 
     if (!state->init) {
+        /* a restart leaves the old world's file mapped */
+        if (state->world)
+            W_CloseWorldFile(state->world);
+
         state->init = true;
+        state->quit = false;
         state->console = false;
         SDL_StopTextInput();
         input->input_text[2] = '\0';
         input->input_len = 2;
 
-        state->num_ents = 0;
-
+        /* the platform only commits the first granule, everything past *
+         * the stack headers is committed as the stacks grow            */
+        ASSERT(sizeof(struct GameState) + 64 <= Z_COMMIT_GRANULE);
         state->game_stack = Z_NewStack( memory->perm_mem + sizeof(struct GameState),
                                         memory->perm_memsize - sizeof(struct GameState) );
         state->temp_stack = Z_NewStack( memory->temp_mem,
                                         memory->temp_memsize);
+        Z_SetStackCommit(state->game_stack, memory->Commit);
+        Z_SetStackCommit(state->temp_stack, memory->Commit);
+
+        /* scratch 0 always belongs to the main thread */
+        state->num_scratch = MAX(1, MIN(SDL_GetCPUCount(), MAX_THREADS));
+        for (u32 i = 0; i < state->num_scratch; i++)
+            state->scratch[i] = Z_NewSubStack(state->temp_stack, SCRATCH_SIZE, MEM_GENERAL);
 
         /* TODO(david): change the way the stack is set up */
-        state->world = Z_PushStruct(state->game_stack, struct WorldState, true);
-        state->world->stack = Z_NewSubStack( state->game_stack,
-                                             Z_RemainingStack(state->game_stack) );
+        state->world = Z_PushStructAligned(state->game_stack, struct WorldState, Z_CACHELINE,
+                                            MEM_WORLD, true);
+        W_InitWorld(state->world, Z_NewSubStack( state->game_stack,
+                                                 Z_RemainingStack(state->game_stack),
+                                                 MEM_WORLD ));
+
+        /* last frame's draw order was kept in the old world's columns */
+        state->draw_order    = NULL;
+        state->draw_count    = 0;
+        state->draw_capacity = 0;
+
+        /* the textures are kept, what they hold belonged to the old world */
+        for (u32 i = 0; i < R_BAKE_SLOTS; i++)
+            state->baked[i].version = 0;
+
+        if (memory->world_path)
+            W_OpenWorldFile(state->world, memory->world_path);
 
         W_GenerateWorld(state);
 
-        state->player.chunk = W_GetChunk(state->world, 1, 2, false);
-        state->player.pos = (struct Vec2){ 5.0f, 5.0f };
-        state->player.vel = (struct Vec2){ 0.0f, 0.0f };
-        state->player.rad = (struct Vec2){ 0.35f, 0.2f };
-        state->player.tl_point = (struct Vec2){ 0.4f, 2.0f };
-        state->player.br_point = (struct Vec2){ 0.4f, 0.0f };
-        state->player.animation = CHARACTER_STAND0;
-        state->player.render_off = (struct Vec2){ -0.5f, -1.5f };
-        W_ChunkAddEntity(state->player.chunk, &state->player);
+        struct EntityRow player = {
+            .pos        = { 5.0f, 5.0f },
+            .rad        = { 0.35f, 0.2f },
+            .animation  = CHARACTER_STAND0,
+            .render_off = { -0.5f, -1.5f },
+        };
+        state->player = E_AddEntity(state->world, W_GetChunk(state->world, 1, 2, false),
+                                    ARCH_PLAYER, &player);
 
-        state->cam.x = state->player.pos.x;
-        state->cam.y = state->player.pos.y;
+        state->cam = player.pos;
 
         /* Initialize font as best possible, if it fails then ensure it's NULL */
         if (!TTF_WasInit()) {
@@ -118,11 +315,19 @@ UPDATE(Update) /* memory, input */
         }
     }
 
+    Z_BindScratchStack(state->scratch[0]);
+
+    /* a quit only tears things down, so don't bring the threads back for it */
+    if (!I_IsPressed(&input->quit)) {
+        J_StartJobs(state->num_scratch, state->scratch);
+        W_StartWriter(state->world);
+    }
+
     /* Handle Input ------------------------------------------------------- */
     if (input->input_entered && input->input_len > 0) {
         for (int i = 9; i > 1; i--)
             memcpy(state->buffer[i], state->buffer[i-1], sizeof(state->buffer[i]));
-        I_ExecuteCommand(state, input);
+        I_ExecuteCommand(memory, state, input);
     } else {
         input->input_entered = false;
     }
@@ -132,6 +337,12 @@ UPDATE(Update) /* memory, input */
 
     /* handle everything for quitting out immediately */
     if (I_IsPressed(&input->quit)) {
+        if (!state->quit) {
+            I_ReportMemory(memory, state, false);
+            W_CloseWorldFile(state->world);
+        }
+        J_StopJobs();
+        state->quit = true;
         TTF_CloseFont(state->font);
         state->font = NULL;
         TTF_Quit();
@@ -168,24 +379,510 @@ UPDATE(Update) /* memory, input */
     if (I_IsPressed(&input->move_left)) {
         acc.x -= 1.0f;
     }
-    acc = V2_Mul(25.0f, V2_Norm(acc));
+    /* diagonals are scaled by a constant rather than normalised, a square *
+     * root may be approximated and the same keys have to give the same   *
+     * acceleration on every build                                        */
+    if (acc.x != 0.0f && acc.y != 0.0f)
+        acc = V2_Mul(0.70710678f, acc);
+    acc = V2_Mul(25.0f, acc);
+
+    struct EntityRef player;
+    struct EntityHandle bumped;
+    E_GetEntity(state->world, state->player, &player);
+    Move(state->world, &player, acc, &bumped);
+    E_FixChunk(state->world, &player, true);
+
+    struct EntityRef other;
+    if (E_GetEntity(state->world, bumped, &other))
+        E_SetAwake(state->world, &other, true);
+
+    W_UpdateEntities(state->world);
+
+    /* npcs moving around may have shuffled the player's row */
+    E_GetEntity(state->world, state->player, &player);
+    W_UpdateResidency(state->world, player.chunk);
+    A_UpdateAnimations(state->world);
+
+    if (memory->hash_state)
+        memory->state_hash = E_HashEntities(state->world);
+
+    state->cam = E_TABLE(&player)->pos[player.row];
+}
+
+/**
+ * Get the size a sprite is drawn at, in metres
+ */
+static inline
+struct Vec2
+R_SpriteSize(enum AnimationId animation)
+{
+    /* TODO(david): not hard coded values */
+    struct Vec2 result = { (r32)SPRITES[animation].rect.w / 32.0f, (r32)SPRITES[animation].rect.h / 24.0f };
+    return result;
+}
+
+/**
+ * Check if any of a sprite is inside the view
+ *
+ * @view_lo   : top left of the view
+ * @view_hi   : bottom right of the view
+ * @animation : sprite drawn
+ * @pos       : position relative to the same chunk as the view
+ * @offset    : from pos to the sprite's top left
+ */
+static inline
+bool
+R_SpriteVisible(struct Vec2 view_lo, struct Vec2 view_hi, enum AnimationId animation,
+                struct Vec2 pos, struct Vec2 offset)
+{
+    struct Vec2 lo = V2_Add(pos, offset);
+    struct Vec2 hi = V2_Add(lo, R_SpriteSize(animation));
+    return lo.x < view_hi.x && hi.x > view_lo.x && lo.y < view_hi.y && hi.y > view_lo.y;
+}
 
-    Move(state->world, &state->player, acc);
+/**
+ * Get the key a sprite is drawn in order of
+ *
+ * @layer : what it's drawn with
+ * @pos   : position in the view, relative to the centre chunk
+ */
+static inline
+u32
+R_DrawKey(enum RenderLayer layer, struct Vec2 pos)
+{
+    r32 depth = pos.y * R_DEPTH_STEPS + (r32)(1 << (R_DEPTH_BITS - 1));
+    depth = MAX(MIN(depth, (r32)((1 << R_DEPTH_BITS) - 1)), 0.0f);
+    return ((u32)layer << R_DEPTH_BITS) | (u32)depth;
+}
 
-    state->cam.x = state->player.pos.x;
-    state->cam.y = state->player.pos.y;
+/**
+ * Check if a draw key goes before another, ties go to the one added first
+ */
+static inline
+bool
+R_DrawsBefore(struct DrawKey a, struct DrawKey b)
+{
+    return a.key < b.key || (a.key == b.key && a.index < b.index);
+}
 
-    for (struct Entity *ent = state->player.chunk->head; ent != NULL; ent = ent->next) {
-        u32 duration = SPRITES[ent->animation].dt;
-        if (duration == 1)
+/**
+ * Sort draw keys a byte at a time, keeping the order of equal keys
+ *
+ * @keys   : keys to sort
+ * @temp   : room for as many keys
+ * @count  : number of keys
+ * @return : whichever of the two arrays ended up sorted
+ *
+ * Bytes every key shares are skipped, which is usually the top one.
+ */
+static
+struct DrawKey *
+R_RadixSort(struct DrawKey *keys, struct DrawKey *temp, u32 count)
+{
+    for (u32 shift = 0; shift < R_KEY_BITS && count > 0; shift += 8) {
+        u32 offsets[256] = { 0 };
+        for (u32 i = 0; i < count; i++)
+            offsets[(keys[i].key >> shift) & 0xff]++;
+        if (offsets[(keys[0].key >> shift) & 0xff] == count)
             continue;
 
-        ent->render_dt += MS_PER_UPDATE;
-        u32 index = SPRITES[ent->animation].index;
-        u32 count = SPRITES[ent->animation].count;
-        if (duration < ent->render_dt) {
-            ent->animation = ent->animation + 1 - ((index + 1 == count) ? count : 0);
-            ent->render_dt -= duration;
+        u32 total = 0;
+        for (u32 digit = 0; digit < 256; digit++) {
+            u32 size = offsets[digit];
+            offsets[digit] = total;
+            total += size;
+        }
+
+        for (u32 i = 0; i < count; i++)
+            temp[offsets[(keys[i].key >> shift) & 0xff]++] = keys[i];
+
+        struct DrawKey *swap = keys;
+        keys = temp;
+        temp = swap;
+    }
+
+    return keys;
+}
+
+/**
+ * Sort draw keys starting from the order sprites were drawn in last frame
+ *
+ * @state  : game state holding last frame's order
+ * @cmds   : the frame's draw commands, tiles first
+ * @keys   : a key per command, in the same order
+ * @temp   : room for as many keys
+ * @tiles  : number of tiles at the front
+ * @count  : number of commands
+ * @return : the sorted keys
+ *
+ * Tiles are radix sorted as usual. The sprites are laid out in last
+ * frame's order, with the new ones at the end, and insertion sorted,
+ * which only does work for the few that moved past another. The two are
+ * merged back together, so the order is the same as a full radix sort.
+ *
+ * Each entity's slot remembers its place in last frame's order, which
+ * only counts if the order has the entity at that place, so nothing has
+ * to be cleared and the work follows the sprites drawn, not the slots.
+ */
+static
+struct DrawKey *
+R_SortIncremental(struct GameState *state, struct DrawCommand *cmds, struct DrawKey *keys,
+                  struct DrawKey *temp, u32 tiles, u32 count)
+{
+    struct EntitySlot *slots = state->world->slots;
+    u32 last = state->draw_count;
+    u32 *at = Z_PushArrayAligned(state->temp_stack, u32, last, _Alignof(u32), MEM_RENDER, true);
+    struct DrawKey *sprites = Z_PushArrayAligned(state->temp_stack, struct DrawKey, (count - tiles),
+                                                 _Alignof(struct DrawKey), MEM_RENDER, false);
+    struct DrawKey *out = Z_PushArrayAligned(state->temp_stack, struct DrawKey, count,
+                                             _Alignof(struct DrawKey), MEM_RENDER, false);
+
+    for (u32 i = tiles; i < count; i++) {
+        u32 place = slots[cmds[i].id].draw;
+        if (place < last && state->draw_order[place] == cmds[i].id)
+            at[place] = i + 1;
+    }
+
+    u32 n = 0;
+    for (u32 i = 0; i < last; i++) {
+        if (at[i])
+            sprites[n++] = keys[at[i] - 1];
+    }
+    for (u32 i = tiles; i < count; i++) {
+        u32 place = slots[cmds[i].id].draw;
+        if (place >= last || state->draw_order[place] != cmds[i].id)
+            sprites[n++] = keys[i];
+    }
+
+    for (u32 i = 1; i < n; i++) {
+        struct DrawKey key = sprites[i];
+        u32 j = i;
+        for (; j > 0 && R_DrawsBefore(key, sprites[j - 1]); j--)
+            sprites[j] = sprites[j - 1];
+        sprites[j] = key;
+    }
+
+    /* remember this frame's order for the next one */
+    if (n > state->draw_capacity) {
+        if (state->draw_order != NULL)
+            W_FreeColumn(state->world, state->draw_order, state->draw_capacity * sizeof(u32));
+        state->draw_capacity = MAX(R_DRAW_MIN, state->draw_capacity * 2);
+        while (state->draw_capacity < n)
+            state->draw_capacity *= 2;
+        state->draw_order = W_AllocColumn(state->world, state->draw_capacity * sizeof(u32));
+    }
+    for (u32 i = 0; i < n; i++) {
+        u32 id = cmds[sprites[i].index].id;
+        state->draw_order[i] = id;
+        slots[id].draw = i;
+    }
+    state->draw_count = n;
+
+    struct DrawKey *sorted = R_RadixSort(keys, temp, tiles);
+    u32 t = 0, e = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (e == n || (t < tiles && R_DrawsBefore(sorted[t], sprites[e])))
+            out[i] = sorted[t++];
+        else
+            out[i] = sprites[e++];
+    }
+
+    return out;
+}
+
+/**
+ * Put the frame's draw commands in the order they're drawn in
+ *
+ * @state  : game state, keys go on its temp stack
+ * @cmds   : draw commands, tiles first
+ * @tiles  : number of tiles at the front
+ * @count  : number of commands
+ * @return : a key per command in draw order
+ */
+static
+struct DrawKey *
+R_SortDrawList(struct GameState *state, struct DrawCommand *cmds, u32 tiles, u32 count)
+{
+    struct DrawKey *keys = Z_PushArrayAligned(state->temp_stack, struct DrawKey, count,
+                                              _Alignof(struct DrawKey), MEM_RENDER, false);
+    struct DrawKey *temp = Z_PushArrayAligned(state->temp_stack, struct DrawKey, count,
+                                              _Alignof(struct DrawKey), MEM_RENDER, false);
+    for (u32 i = 0; i < count; i++)
+        keys[i] = (struct DrawKey){ R_DrawKey(LAYER_WORLD, cmds[i].pos), i };
+
+    if (state->draw_incremental)
+        return R_SortIncremental(state, cmds, keys, temp, tiles, count);
+    return R_RadixSort(keys, temp, count);
+}
+
+/**
+ * Start collecting the frame's sprites into batches
+ *
+ * @state    : game state, buffers go on its temp stack
+ * @batch    : batch to set up
+ * @renderer : what the batches are drawn with
+ * @capacity : most sprites the frame will draw
+ */
+static
+void
+R_BeginBatch(struct GameState *state, struct SpriteBatch *batch, SDL_Renderer *renderer, u32 capacity)
+{
+    *batch = (struct SpriteBatch){ .renderer = renderer, .sheets = state->sheets,
+                                   .sheet = SpriteSheet_COUNT, .capacity = capacity };
+
+#if defined(R_GEOMETRY)
+    batch->vertices = Z_PushArrayAligned(state->temp_stack, SDL_Vertex, (4 * capacity),
+                                         _Alignof(SDL_Vertex), MEM_RENDER, false);
+    batch->indices  = Z_PushArrayAligned(state->temp_stack, int, (6 * capacity),
+                                         _Alignof(int), MEM_RENDER, false);
+    for (u32 q = 0; q < capacity; q++) {
+        int base = 4 * q;
+        int *quad = &batch->indices[6 * q];
+        quad[0] = base;
+        quad[1] = base + 1;
+        quad[2] = base + 2;
+        quad[3] = base + 2;
+        quad[4] = base + 1;
+        quad[5] = base + 3;
+    }
+#endif
+}
+
+/**
+ * Draw whatever quads are waiting with a single call
+ */
+static
+void
+R_FlushBatch(struct SpriteBatch *batch)
+{
+#if defined(R_GEOMETRY)
+    SDL_Texture *texture = (batch->sheet < SpriteSheet_COUNT) ? batch->sheets[batch->sheet].texture : NULL;
+    if (batch->count > 0 && texture != NULL) {
+        SDL_RenderGeometry(batch->renderer, texture, batch->vertices, 4 * batch->count,
+                           batch->indices, 6 * batch->count);
+        batch->calls++;
+    }
+#endif
+    batch->count = 0;
+}
+
+/**
+ * Add a sprite to the batch, flushing it first if it's for another sheet
+ *
+ * @batch : the frame's batch
+ * @sheet : sheet the sprite comes from
+ * @src   : part of the sheet to draw
+ * @dst   : where it goes on screen
+ *
+ * Without SDL_RenderGeometry every sprite is still copied on its own.
+ */
+static
+void
+R_BatchSprite(struct SpriteBatch *batch, enum SpriteSheetId sheet, SDL_Rect *src, SDL_Rect *dst)
+{
+    batch->sprites++;
+    if (sheet != batch->sheet) {
+        R_FlushBatch(batch);
+        batch->sheet = sheet;
+        batch->batches++;
+
+        batch->tex_w = (r32)MAX(batch->sheets[sheet].w, 1);
+        batch->tex_h = (r32)MAX(batch->sheets[sheet].h, 1);
+    }
+
+#if defined(R_GEOMETRY)
+    ASSERT(batch->count < batch->capacity);
+    SDL_Vertex *quad = &batch->vertices[4 * batch->count++];
+    r32 u0 = src->x / batch->tex_w;
+    r32 v0 = src->y / batch->tex_h;
+    r32 u1 = (src->x + src->w) / batch->tex_w;
+    r32 v1 = (src->y + src->h) / batch->tex_h;
+    r32 x0 = (r32)dst->x;
+    r32 y0 = (r32)dst->y;
+    r32 x1 = (r32)(dst->x + dst->w);
+    r32 y1 = (r32)(dst->y + dst->h);
+    SDL_Color white = { 255, 255, 255, 255 };
+
+    quad[0] = (SDL_Vertex){ { x0, y0 }, white, { u0, v0 } };
+    quad[1] = (SDL_Vertex){ { x1, y0 }, white, { u1, v0 } };
+    quad[2] = (SDL_Vertex){ { x0, y1 }, white, { u0, v1 } };
+    quad[3] = (SDL_Vertex){ { x1, y1 }, white, { u1, v1 } };
+#else
+    SDL_RenderCopy(batch->renderer, batch->sheets[sheet].texture, src, dst);
+    batch->calls++;
+#endif
+}
+
+/**
+ * Check if a tile's sprite can be baked into its chunk's texture, it has
+ * to be still and fit inside the texture
+ *
+ * @animation : sprite drawn
+ * @pos       : position relative to the tile's own chunk
+ * @offset    : from pos to the sprite's top left
+ */
+static inline
+bool
+R_Bakes(enum AnimationId animation, struct Vec2 pos, struct Vec2 offset)
+{
+    struct Vec2 lo = V2_Add(pos, offset);
+    struct Vec2 hi = V2_Add(lo, R_SpriteSize(animation));
+    return SPRITES[animation].dt == 1 && lo.x >= 0.0f && hi.x <= W_CHUNK_DIM &&
+           lo.y >= -R_BAKE_TOP && hi.y <= W_CHUNK_DIM;
+}
+
+/**
+ * Get the rect a sprite covers on screen, or in a chunk texture
+ *
+ * @origin    : where the chunk pos is relative to lands
+ * @animation : sprite drawn
+ * @pos       : position relative to that chunk
+ * @offset    : from pos to the sprite's top left
+ *
+ * Every sprite is placed from a chunk corner rounded to whole pixels, so
+ * a sprite lands on the same pixels whether it was baked or not.
+ */
+static inline
+SDL_Rect
+R_SpriteRect(SDL_Point origin, enum AnimationId animation, struct Vec2 pos, struct Vec2 offset)
+{
+    struct Vec2 size = R_SpriteSize(animation);
+    SDL_Rect result = {
+        origin.x + (int)floorf((pos.x + offset.x) * PIXEL_PERMETERX),
+        origin.y + (int)floorf((pos.y + offset.y) * PIXEL_PERMETERY),
+        PIXEL_PERMETERX * size.x,
+        PIXEL_PERMETERY * size.y,
+    };
+    return result;
+}
+
+/**
+ * Get a texture of a chunk's floor and still tiles, baking it if there
+ * isn't one that's up to date
+ *
+ * @state    : game state holding the textures
+ * @renderer : what the texture is for
+ * @chunk    : chunk to draw
+ * @return   : the baked chunk, NULL when every texture is already in use
+ *             this frame or one couldn't be made
+ *
+ * When none is free the texture drawn the longest ago is baked over, and
+ * no more are ever made than fit in R_BAKE_MEMORY.
+ */
+static
+struct BakedChunk *
+R_BakeChunk(struct GameState *state, SDL_Renderer *renderer, struct WorldChunk *chunk)
+{
+    struct BakedChunk *result = NULL;
+    for (u32 i = 0; i < R_BAKE_SLOTS; i++) {
+        struct BakedChunk *baked = &state->baked[i];
+        if (baked->version == chunk->version && baked->x == chunk->x && baked->y == chunk->y) {
+            baked->used = state->frame;
+            return baked;
+        }
+        if (baked->used != state->frame && (result == NULL || baked->used < result->used))
+            result = baked;
+    }
+
+    if (result == NULL)
+        return NULL;
+
+    if (result->texture == NULL) {
+        result->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                            R_BAKE_W, R_BAKE_H);
+        if (result->texture == NULL) {
+            SDL_LOG("couldn't create a chunk texture");
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(result->texture, SDL_BLENDMODE_BLEND);
+    }
+
+    /* the room above the chunk stays clear, it's drawn over its neighbour */
+    SDL_SetRenderTarget(renderer, result->texture);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    SDL_Rect rect_floor = { 0, R_BAKE_TOP * PIXEL_PERMETERY, R_BAKE_W, W_CHUNK_DIM * PIXEL_PERMETERY };
+    SDL_SetRenderDrawColor(renderer, 125, 125, 125, 255);
+    SDL_RenderFillRect(renderer, &rect_floor);
+
+    struct LocalStack bake_stack;
+    Z_BeginLocalStack(&bake_stack, state->temp_stack);
+
+    /* row by row is the order they'd be drawn in anyway */
+    struct SpriteBatch batch;
+    R_BeginBatch(state, &batch, renderer, W_CHUNK_DIM * W_CHUNK_DIM);
+    SDL_Point origin = { 0, R_BAKE_TOP * PIXEL_PERMETERY };
+    for (int y = 0; y < W_CHUNK_DIM; y++) {
+        for (int x = 0; x < W_CHUNK_DIM; x++) {
+            struct TileInfo *tile = &W_TILES[chunk->tiles[y * W_CHUNK_DIM + x]];
+            struct Vec2 pos = { x + 0.5f, y + 0.5f };
+            if (!tile->drawn || !R_Bakes(tile->animation, pos, tile->render_off))
+                continue;
+
+            SDL_Rect rect = R_SpriteRect(origin, tile->animation, pos, tile->render_off);
+            R_BatchSprite(&batch, SPRITES[tile->animation].sheet, &SPRITES[tile->animation].rect, &rect);
+        }
+    }
+    R_FlushBatch(&batch);
+
+    Z_EndLocalStack(&bake_stack);
+    SDL_SetRenderTarget(renderer, NULL);
+
+    result->x       = chunk->x;
+    result->y       = chunk->y;
+    result->version = chunk->version;
+    result->used    = state->frame;
+    state->draw_bakes++;
+    return result;
+}
+
+/* what's known about the tiles in view while deciding which to draw */
+struct ViewTiles {
+    struct DrawCommand *cmds;   /* one per drawn tile in view, row by row */
+    u8                 *baked;  /* per cmd, R_TILE_* */
+    u32                 count;
+
+    u32 *grid;                  /* cmd + 1 of baked tiles by tile, 0 for the rest */
+    i32  x0, y0;                /* tile at the grid's corner */
+    i32  w, h;
+    r32  reach;                 /* furthest a sprite reaches from its tile */
+};
+
+enum TileBake {
+    R_TILE_LOOSE,               /* drawn as a sprite */
+    R_TILE_BAKED,               /* in its chunk's texture */
+    R_TILE_REDRAWN,             /* baked, but has to go over something drawn after the textures */
+    TileBake_COUNT
+};
+
+/**
+ * Mark baked tiles that draw after a sprite and overlap it, so they get
+ * drawn again on top of it
+ *
+ * @view  : tiles in view
+ * @after : only tiles from this cmd on are looked at
+ * @key   : draw key of the sprite, tiles with a greater one draw after it
+ * @lo    : top left of the sprite
+ * @hi    : bottom right of the sprite
+ */
+static
+void
+R_MarkRedraws(struct ViewTiles *view, u32 after, u32 key, struct Vec2 lo, struct Vec2 hi)
+{
+    i32 x0 = MAX((i32)floorf(lo.x - view->reach) - view->x0, 0);
+    i32 y0 = MAX((i32)floorf(lo.y - view->reach) - view->y0, 0);
+    i32 x1 = MIN((i32)floorf(hi.x + view->reach) - view->x0, view->w - 1);
+    i32 y1 = MIN((i32)floorf(hi.y + view->reach) - view->y0, view->h - 1);
+    for (i32 y = y0; y <= y1; y++) {
+        for (i32 x = x0; x <= x1; x++) {
+            u32 cell = view->grid[y * view->w + x];
+            if (cell == 0 || cell - 1 < after || view->baked[cell - 1] != R_TILE_BAKED)
+                continue;
+
+            struct DrawCommand *cmd = &view->cmds[cell - 1];
+            if (R_DrawKey(LAYER_WORLD, cmd->pos) > key &&
+                R_SpriteVisible(lo, hi, cmd->animation, cmd->pos, cmd->offset))
+                view->baked[cell - 1] = R_TILE_REDRAWN;
         }
     }
 }
@@ -210,82 +907,204 @@ RENDER(Render) /* memory, renderer, dt */
 
     if (!state->init) return;
 
+    Z_BindScratchStack(state->scratch[0]);
+
     struct LocalStack render_stack;
     Z_BeginLocalStack(&render_stack, state->temp_stack);
 
-    if (state->sheets[CHARACTER].w != ~0) {
+    if (!state->sheets_loaded) {
         int initted = IMG_Init(IMG_INIT_PNG);
         if (initted != IMG_INIT_PNG)
             SDL_LOG("img init failed");
 
-        /* TODO(david): automate this */
-        SDL_Surface *temp;
-        temp = IMG_Load("../res/sprites/character.png");
-        state->sheets[CHARACTER].texture = SDL_CreateTextureFromSurface(renderer, temp);
-        state->sheets[CHARACTER].w = ~0;
-        SDL_FreeSurface(temp);
+        /* every sheet was packed into the atlas pages by make config */
+        for (int sheet = 0; sheet < SpriteSheet_COUNT; sheet++) {
+            SDL_Surface *temp = IMG_Load(SHEET_FILES[sheet]);
+            if (temp == NULL) {
+                SDL_LOG("couldn't load an atlas page");
+                continue;
+            }
+            state->sheets[sheet].texture = SDL_CreateTextureFromSurface(renderer, temp);
+            state->sheets[sheet].w = temp->w;
+            state->sheets[sheet].h = temp->h;
+            SDL_FreeSurface(temp);
+        }
+        state->sheets_loaded = true;
+    }
+
+    state->frame++;
+
+    struct EntityRef player;
+    E_GetEntity(state->world, state->player, &player);
+
+    /* what the camera sees, relative to the player's chunk, with a pixel *
+     * to spare for rects being rounded to whole pixels                   */
+    struct Vec2 half = { (screenw / 2.0f + 1.0f) / PIXEL_PERMETERX, (screenh / 2.0f + 1.0f) / PIXEL_PERMETERY };
+    struct Vec2 view_lo = V2_Sub(state->cam, half);
+    struct Vec2 view_hi = V2_Add(state->cam, half);
+
+    /* where the player's chunk lands on screen */
+    SDL_Point origin = {
+        (int)floorf(screenw / 2.0f - state->cam.x * PIXEL_PERMETERX + 0.5f),
+        (int)floorf(screenh / 2.0f - state->cam.y * PIXEL_PERMETERY + 0.5f),
+    };
 
-        temp = IMG_Load("../res/sprites/tile_wall.png");
-        state->sheets[TILE_WALL].texture = SDL_CreateTextureFromSurface(renderer, temp);
-        SDL_FreeSurface(temp);
+    /* chunks whose texture is in view, the textures reach R_BAKE_TOP *
+     * above their chunk so the ones just below the view count too    */
+    i32 chunk_x0 = (i32)floorf(view_lo.x / W_CHUNK_DIM);
+    i32 chunk_y0 = (i32)floorf(view_lo.y / W_CHUNK_DIM);
+    i32 chunk_w  = (i32)floorf(view_hi.x / W_CHUNK_DIM) - chunk_x0 + 1;
+    i32 chunk_h  = (i32)floorf((view_hi.y + R_BAKE_TOP) / W_CHUNK_DIM) - chunk_y0 + 1;
+    struct BakedChunk **bakes = Z_PushArrayAligned(state->temp_stack, struct BakedChunk *, (chunk_w * chunk_h),
+                                                   _Alignof(struct BakedChunk *), MEM_RENDER, true);
+
+    /* baking changes the render target, so it's all done before the *
+     * screen is drawn to                                            */
+    if (SDL_RenderTargetSupported(renderer)) {
+        for (i32 y = 0; y < chunk_h; y++) {
+            for (i32 x = 0; x < chunk_w; x++) {
+                struct WorldChunk *chunk = W_GetChunk(state->world, player.chunk->x + chunk_x0 + x,
+                                                      player.chunk->y + chunk_y0 + y, false);
+                if (chunk != NULL)
+                    bakes[y * chunk_w + x] = R_BakeChunk(state, renderer, chunk);
+            }
+        }
     }
 
+    /* chunks that couldn't be baked still get a floor from this */
     SDL_SetRenderDrawColor(renderer, 125, 125, 125, 255);
     SDL_RenderClear(renderer);
 
-    /* TODO(david): render the floor */
+    /* sprites hang off their entity's box, so look as far out as the *
+     * biggest one can reach into the view and cull each exactly      */
+    r32 reach = R_OFFSET_MAX;
+    for (int anim = 0; anim < Anim_COUNT; anim++) {
+        struct Vec2 size = R_SpriteSize(anim);
+        reach = MAX(reach, R_OFFSET_MAX + MAX(size.x, size.y));
+    }
+    struct Vec2 query_lo = { view_lo.x - reach, view_lo.y - reach };
+    struct Vec2 query_hi = { view_hi.x + reach, view_hi.y + reach };
 
-    struct RenderLink *first = NULL;
-    u32 chunkx = state->player.chunk->x;
-    u32 chunky = state->player.chunk->y;
-    for (int i = -1; i < 2; i++) {
-        for (int j = -1; j < 2; j++) {
-            struct WorldChunk *chunk = W_GetChunk(state->world, chunkx + i, chunky + j, false);
-            if (chunk == NULL)
-                continue;
+    /* chunks outside the query are never looked at */
+    struct Stack *scratch = Z_ScratchStack();
+    struct LocalStack scratch_stack;
+    Z_BeginLocalStack(&scratch_stack, scratch);
 
-            for (struct Entity *ent = chunk->head; ent != NULL; ent = ent->next) {
-                struct RenderLink *new = Z_PushStruct(state->temp_stack, struct RenderLink, true);
-                new->ent = ent;
-                new->pos = (struct Vec2){ent->pos.x + i * W_CHUNK_DIM, ent->pos.y + j * W_CHUNK_DIM};
-
-                for (struct RenderLink *ren = first; ren != NULL; ren = ren->next) {
-                    if (ren->pos.y > new->pos.y) {
-                        if (ren == first) {
-                            first = new;
-                            ren->prev = first;
-                        } else {
-                            ren->prev->next = new;
-                            ren->prev = ren->prev->next;
-                        }
-                        ren->prev->next = ren;
-                        break;
-                    } else if (ren->next == NULL) {
-                        ren->next = new;
-                        new->prev = ren;
-                        break;
-                    }
-                }
+    struct QueryTiles tiles;
+    struct QueryHits sprites;
+    Q_Tiles(state->world, player.chunk, query_lo, query_hi, scratch, &tiles);
+    Q_Box(state->world, player.chunk, query_lo, query_hi,
+          COMP_BIT(COMP_ANIMATION) | COMP_BIT(COMP_RENDER_OFF), scratch, &sprites);
 
-                if (first == NULL)
-                    first = new;
-            }
-        }
+    struct ViewTiles view = {
+        .x0    = (i32)floorf(query_lo.x),
+        .y0    = (i32)floorf(query_lo.y),
+        .reach = reach,
+    };
+    view.w     = (i32)floorf(query_hi.x) - view.x0 + 1;
+    view.h     = (i32)floorf(query_hi.y) - view.y0 + 1;
+    view.cmds  = Z_PushArrayAligned(state->temp_stack, struct DrawCommand, tiles.count,
+                                    _Alignof(struct DrawCommand), MEM_RENDER, false);
+    view.baked = Z_PushArrayAligned(state->temp_stack, u8, tiles.count, _Alignof(u8), MEM_RENDER, false);
+    view.grid  = Z_PushArrayAligned(state->temp_stack, u32, (view.w * view.h), _Alignof(u32), MEM_RENDER, true);
+    for (u32 i = 0; i < tiles.count; i++) {
+        struct QueryTile *query_tile = &tiles.tiles[i];
+        struct TileInfo *tile = &W_TILES[query_tile->tile];
+        struct Vec2 pos = { query_tile->x + 0.5f, query_tile->y + 0.5f };
+        if (!tile->drawn || !R_SpriteVisible(view_lo, view_hi, tile->animation, pos, tile->render_off))
+            continue;
+
+        /* a tile is baked when its chunk is and its sprite fits the texture */
+        i32 cx = (i32)floorf((r32)query_tile->x / W_CHUNK_DIM);
+        i32 cy = (i32)floorf((r32)query_tile->y / W_CHUNK_DIM);
+        struct Vec2 local = { pos.x - cx * W_CHUNK_DIM, pos.y - cy * W_CHUNK_DIM };
+        bool baked = cx >= chunk_x0 && cx < chunk_x0 + chunk_w && cy >= chunk_y0 && cy < chunk_y0 + chunk_h &&
+                     bakes[(cy - chunk_y0) * chunk_w + (cx - chunk_x0)] != NULL &&
+                     R_Bakes(tile->animation, local, tile->render_off);
+
+        view.baked[view.count] = baked ? R_TILE_BAKED : R_TILE_LOOSE;
+        view.cmds[view.count]  = (struct DrawCommand){ tile->animation, pos, tile->render_off, ~0u };
+        if (baked)
+            view.grid[(query_tile->y - view.y0) * view.w + (query_tile->x - view.x0)] = view.count + 1;
+        view.count++;
+    }
+
+    u32 count = 0;
+    struct DrawCommand *cmds = Z_PushArrayAligned(state->temp_stack, struct DrawCommand,
+                                                  (view.count + sprites.count),
+                                                  _Alignof(struct DrawCommand), MEM_RENDER, false);
+    struct DrawCommand *actors = &cmds[view.count];
+    u32 actor_count = 0;
+    for (u32 i = 0; i < sprites.count; i++) {
+        struct QueryHit *hit = &sprites.hits[i];
+        struct EntityTable *table = E_TABLE(&hit->ref);
+        u32 animation = table->animation[hit->ref.row];
+        struct Vec2 offset = table->render_off[hit->ref.row];
+        if (!R_SpriteVisible(view_lo, view_hi, animation, hit->pos, offset))
+            continue;
+
+        actors[actor_count++] = (struct DrawCommand){ animation, hit->pos, offset, table->id[hit->ref.row] };
+
+        struct Vec2 lo = V2_Add(hit->pos, offset);
+        R_MarkRedraws(&view, 0, R_DrawKey(LAYER_WORLD, hit->pos), lo, V2_Add(lo, R_SpriteSize(animation)));
+    }
+
+    Z_EndLocalStack(&scratch_stack);
+
+    /* tiles are in draw order, so a single pass catches baked tiles that *
+     * have to go over loose ones, or over ones that are themselves drawn *
+     * again, and later tiles in the same row draw after it too           */
+    for (u32 i = 0; i < view.count; i++) {
+        struct DrawCommand *cmd = &view.cmds[i];
+        if (view.baked[i] == R_TILE_BAKED)
+            continue;
+
+        struct Vec2 lo = V2_Add(cmd->pos, cmd->offset);
+        R_MarkRedraws(&view, i + 1, R_DrawKey(LAYER_WORLD, cmd->pos) - 1,
+                      lo, V2_Add(lo, R_SpriteSize(cmd->animation)));
+        cmds[count++] = *cmd;
     }
 
-    SDL_Rect rect;
-    for (struct RenderLink *ren = first; ren != NULL; ren = ren->next) {
-        struct Entity *ent = ren->ent;
-        struct Animation *anim = &SPRITES[ent->animation];
+    /* actors go after the tiles, which is where the sort expects them */
+    u32 drawn_tiles = count;
+    for (u32 i = 0; i < actor_count; i++)
+        cmds[count++] = actors[i];
 
-        rect.x = (ren->pos.x + ent->render_off.x - state->cam.x) * PIXEL_PERMETERX + 0.5f + (screenw / 2.0f);
-        rect.y = (ren->pos.y + ent->render_off.y - state->cam.y) * PIXEL_PERMETERY + 0.5f + (screenh / 2.0f);
-        rect.w = PIXEL_PERMETERX * ((float)(anim->rect.w) / 32.0f); /* TODO(david): not hard coded values */
-        rect.h = PIXEL_PERMETERY * ((float)(anim->rect.h) / 24.0f);
+    struct DrawKey *order = R_SortDrawList(state, cmds, drawn_tiles, count);
 
-        SDL_RenderCopy(renderer, state->sheets[anim->sheet].texture, &anim->rect, &rect);
+    u32 chunk_draws = 0;
+    for (i32 y = 0; y < chunk_h; y++) {
+        for (i32 x = 0; x < chunk_w; x++) {
+            struct BakedChunk *baked = bakes[y * chunk_w + x];
+            if (baked == NULL)
+                continue;
+
+            SDL_Rect rect = {
+                origin.x + (chunk_x0 + x) * R_BAKE_W,
+                origin.y + ((chunk_y0 + y) * W_CHUNK_DIM - R_BAKE_TOP) * PIXEL_PERMETERY,
+                R_BAKE_W,
+                R_BAKE_H,
+            };
+            SDL_RenderCopy(renderer, baked->texture, NULL, &rect);
+            chunk_draws++;
+        }
     }
 
+    struct SpriteBatch batch;
+    R_BeginBatch(state, &batch, renderer, count);
+
+    for (u32 i = 0; i < count; i++) {
+        struct DrawCommand *cmd = &cmds[order[i].index];
+        struct Animation *anim = &SPRITES[cmd->animation];
+        SDL_Rect rect = R_SpriteRect(origin, cmd->animation, cmd->pos, cmd->offset);
+        R_BatchSprite(&batch, anim->sheet, &anim->rect, &rect);
+    }
+
+    R_FlushBatch(&batch);
+    state->draw_sprites = batch.sprites;
+    state->draw_batches = batch.batches;
+    state->draw_calls   = batch.calls + chunk_draws;
+
     if (state->console && state->font != NULL) {
         int width, height;
         SDL_RenderGetLogicalSize(renderer, &width, &height);
@@ -5,27 +5,85 @@
 #include "math.h"
 #include "memory.h"
 #include "entity.h"
+#include "world.h"
+#include "job.h"
 
 #include <SDL2/SDL_ttf.h>
 
 #define PIXEL_PERMETERX 64
 #define PIXEL_PERMETERY 48
 
-struct RenderLink {
-    struct Entity     *ent;
+/* draw keys sort by layer first, then by y so lower sprites draw over *
+ * higher ones, sprites with the same key keep the order they came in  */
+enum RenderLayer {
+    LAYER_FLOOR,
+    LAYER_WORLD,
+    RenderLayer_COUNT
+};
+
+#define R_DEPTH_BITS  (20)
+#define R_DEPTH_STEPS (1024.0f) /* keys per metre of y */
+#define R_KEY_BITS    (24)      /* layer above the depth, sorted a byte at a time */
+#define R_DRAW_MIN    (256)     /* sprites remembered for incremental sorts */
+#define R_OFFSET_MAX  (2.0f)    /* furthest a sprite is drawn from its entity */
+
+struct DrawCommand {
+    enum AnimationId animation;
+    struct Vec2      pos;
+    struct Vec2      offset; /* from pos to the sprite's top left */
+    u32              id;     /* handle slot, ~0 for tiles */
+};
+
+struct DrawKey {
+    u32 key;
+    u32 index; /* into the frame's draw commands */
+};
+
+/* quads waiting to be drawn from one sheet, flushed whenever the sheet *
+ * changes so sprites still go down in draw order                       */
+struct SpriteBatch {
+    SDL_Renderer       *renderer;
+    struct SpriteSheet *sheets;
+    enum SpriteSheetId  sheet;      /* SpriteSheet_COUNT before the first sprite */
+    r32                 tex_w;      /* size of the sheet's texture, for texture coordinates */
+    r32                 tex_h;
 
-    struct RenderLink *next;
-    struct RenderLink *prev;
+    u32         count;              /* quads waiting */
+    u32         capacity;
+    SDL_Vertex *vertices;           /* four per quad */
+    int        *indices;            /* six per quad, the same for every run */
 
-    struct Vec2        pos;
+    u32 sprites;
+    u32 batches;                    /* runs of the same sheet */
+    u32 calls;                      /* draw calls made for them */
 };
 
-#define MAX_ENTITIES 1024
+/* a chunk's floor and static tile sprites drawn once into a texture, *
+ * which has room above the chunk for sprites that stick out the top  */
+#define R_BAKE_TOP    (2)    /* metres above its chunk a baked sprite may reach */
+#define R_BAKE_W      (W_CHUNK_DIM * PIXEL_PERMETERX)
+#define R_BAKE_H      ((W_CHUNK_DIM + R_BAKE_TOP) * PIXEL_PERMETERY)
+#define R_BAKE_MEMORY MEGABYTES(48)
+#define R_BAKE_SLOTS  (R_BAKE_MEMORY / (R_BAKE_W * R_BAKE_H * 4))
+
+struct BakedChunk {
+    SDL_Texture *texture;   /* NULL until the slot is first used */
+    u32 x, y;               /* chunk it holds */
+    u32 version;            /* of the chunk's tiles when baked, 0 when it holds nothing */
+    u64 used;               /* frame it was last drawn in */
+};
+
+#define MAX_THREADS  J_MAX_THREADS
+#define SCRATCH_SIZE MEGABYTES(2)
+
 struct GameState {
     bool init;
+    bool quit;
 
     struct Stack *game_stack;
     struct Stack *temp_stack;
+    struct Stack *scratch[MAX_THREADS]; /* per thread, carved from temp */
+    u32 num_scratch;
     struct WorldState *world;
 
     TTF_Font *font;
@@ -36,12 +94,28 @@ struct GameState {
     struct Vec2 cam; /* camera to compare to */
 
     /* player */
-    struct Entity player;
-    struct Entity ents[MAX_ENTITIES];
-    int num_ents;
+    struct EntityHandle player;
 
     /* rendering */
     struct SpriteSheet sheets[SpriteSheet_COUNT];
+    bool sheets_loaded;
+
+    /* last frame's sprites by handle slot in the order they were drawn, *
+     * an incremental sort starts from it since sprites barely move      */
+    bool draw_incremental;
+    u32 *draw_order;
+    u32  draw_count;
+    u32  draw_capacity;
+
+    /* last frame's sprite submission, for the console */
+    u32 draw_sprites;
+    u32 draw_batches;
+    u32 draw_calls;
+    u32 draw_bakes;     /* chunks baked */
+
+    /* least recently drawn chunk textures are baked over first */
+    struct BakedChunk baked[R_BAKE_SLOTS];
+    u64 frame;
 };
 
 #endif
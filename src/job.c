@@ -0,0 +1,304 @@
+#include <SDL2/SDL.h>
+
+#include "job.h"
+
+/* per thread deque, the owner pushes and pops at the bottom while others *
+ * steal from the top (Chase and Lev), each on its own cache lines       */
+struct JobDeque {
+    i64 top    __attribute__((aligned(Z_CACHELINE)));
+    i64 bottom __attribute__((aligned(Z_CACHELINE)));
+    struct Job jobs[J_DEQUE_SIZE] __attribute__((aligned(Z_CACHELINE)));
+};
+
+/* the workers run library code, so the pool lives and dies with the   *
+ * library rather than the game memory and has to be stopped before a *
+ * reload; a freshly loaded library starts out with no workers         */
+static struct JobDeque j_deques[J_MAX_THREADS];
+static struct Stack   *j_scratch[J_MAX_THREADS];
+static SDL_Thread     *j_threads[J_MAX_THREADS];
+static SDL_sem        *j_wake;
+static u32             j_count = 0; /* threads including the main one, 0 when stopped */
+static i32             j_quit;
+static i32             j_sleeping;
+
+/* deque of the calling thread, 0 is the main thread */
+static __thread u32 j_index = 0;
+
+/**
+ * Queue a job at the bottom of a deque, only ever from its owner
+ *
+ * @deque  : the calling thread's deque
+ * @job    : what to queue
+ * @return : false if the deque is full
+ */
+static
+bool
+J_Push(struct JobDeque *deque, struct Job *job)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    i64 top    = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= J_DEQUE_SIZE)
+        return false;
+
+    deque->jobs[bottom & (J_DEQUE_SIZE - 1)] = *job;
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Take the newest job off the bottom of a deque, only ever from its owner
+ *
+ * @deque  : the calling thread's deque
+ * @job    : filled in with the job
+ * @return : false if there was nothing to take
+ */
+static
+bool
+J_Pop(struct JobDeque *deque, struct Job *job)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *job = deque->jobs[bottom & (J_DEQUE_SIZE - 1)];
+    if (top == bottom) {
+        /* last one, race the thieves for it */
+        bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                               __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return won;
+    }
+    return true;
+}
+
+/**
+ * Take the oldest job off the top of another thread's deque
+ *
+ * @deque  : deque to steal from
+ * @job    : filled in with the job
+ * @return : false if it was empty or another thread got there first
+ */
+static
+bool
+J_Steal(struct JobDeque *deque, struct Job *job)
+{
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+        return false;
+
+    *job = deque->jobs[top & (J_DEQUE_SIZE - 1)];
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/**
+ * Find something to do, own work first and then anyone else's
+ *
+ * @index  : the calling thread
+ * @job    : filled in with the job
+ * @return : false if nothing was found
+ */
+static
+bool
+J_Find(u32 index, struct Job *job)
+{
+    if (J_Pop(&j_deques[index], job))
+        return true;
+
+    for (u32 i = 1; i < j_count; i++) {
+        if (J_Steal(&j_deques[(index + i) % j_count], job))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Run a job and count it as done
+ *
+ * @job : the job
+ */
+static
+void
+J_Execute(struct Job *job)
+{
+    job->func(job->data, job->start, job->end);
+    __atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Worker thread, runs jobs until told to quit
+ *
+ * @arg    : index of the worker's deque and scratch stack
+ * @return : 0
+ *
+ * Spins on stealing for a little before sleeping, and checks once more
+ * after saying it's asleep so a job pushed meanwhile isn't missed.
+ */
+static
+int
+J_Worker(void *arg)
+{
+    j_index = (u32)(uptr)arg;
+    Z_BindScratchStack(j_scratch[j_index]);
+
+    u32 misses = 0;
+    struct Job job;
+    while (!__atomic_load_n(&j_quit, __ATOMIC_ACQUIRE)) {
+        if (J_Find(j_index, &job)) {
+            J_Execute(&job);
+            misses = 0;
+            continue;
+        }
+        if (++misses < J_SPIN)
+            continue;
+
+        __atomic_add_fetch(&j_sleeping, 1, __ATOMIC_SEQ_CST);
+        if (J_Find(j_index, &job)) {
+            __atomic_sub_fetch(&j_sleeping, 1, __ATOMIC_SEQ_CST);
+            J_Execute(&job);
+        } else {
+            SDL_SemWait(j_wake);
+            __atomic_sub_fetch(&j_sleeping, 1, __ATOMIC_SEQ_CST);
+        }
+        misses = 0;
+    }
+    return 0;
+}
+
+/**
+ * Start the worker threads, does nothing if they're already running
+ *
+ * @count   : threads to use including the calling one, at most J_MAX_THREADS
+ * @scratch : scratch stack for each thread, the calling one's is first
+ */
+void
+J_StartJobs(u32 count, struct Stack **scratch)
+{
+    if (j_count != 0)
+        return;
+
+    count = MAX(1, MIN(count, J_MAX_THREADS));
+    for (u32 i = 0; i < count; i++) {
+        j_deques[i].top    = 0;
+        j_deques[i].bottom = 0;
+        j_scratch[i]       = scratch[i];
+    }
+
+    j_quit     = false;
+    j_sleeping = 0;
+    j_wake     = SDL_CreateSemaphore(0);
+    j_count    = count;
+    for (u32 i = 1; i < count; i++) {
+        j_threads[i] = SDL_CreateThread(J_Worker, "worker", (void *)(uptr)i);
+        if (j_threads[i] == NULL) {
+            fprintf(stderr, "Can't start worker %u: %s\n", i, SDL_GetError());
+            j_count = i; /* stealing only looks at deques below the count */
+            break;
+        }
+    }
+}
+
+/**
+ * Stop the worker threads, must be called before the library is unloaded
+ *
+ * Anything still queued is left undone, nothing should be.
+ */
+void
+J_StopJobs(void)
+{
+    if (j_count == 0)
+        return;
+
+    __atomic_store_n(&j_quit, true, __ATOMIC_RELEASE);
+    for (u32 i = 1; i < j_count; i++)
+        SDL_SemPost(j_wake);
+    for (u32 i = 1; i < j_count; i++)
+        SDL_WaitThread(j_threads[i], NULL);
+
+    SDL_DestroySemaphore(j_wake);
+    j_wake  = NULL;
+    j_count = 0;
+}
+
+/**
+ * Get how many threads jobs are spread over
+ *
+ * @return : threads including the main one, 1 when the workers are stopped
+ */
+u32
+J_ThreadCount(void)
+{
+    return MAX(j_count, 1);
+}
+
+/**
+ * Queue a job on the calling thread's deque
+ *
+ * @func    : what to run
+ * @data    : passed to func
+ * @start   : start of the range
+ * @end     : end of the range
+ * @counter : counted up now and down once the job is done
+ *
+ * Runs the job straight away when the workers are stopped or the deque is
+ * full.
+ */
+void
+J_Spawn(JobFunc *func, void *data, u32 start, u32 end, struct JobCounter *counter)
+{
+    struct Job job = { func, data, start, end, counter };
+    __atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+
+    if (j_count <= 1 || !J_Push(&j_deques[j_index], &job)) {
+        J_Execute(&job);
+        return;
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&j_sleeping, __ATOMIC_SEQ_CST) > 0)
+        SDL_SemPost(j_wake);
+}
+
+/**
+ * Help run jobs until every job on a counter is done
+ *
+ * @counter : the counter
+ */
+void
+J_Wait(struct JobCounter *counter)
+{
+    struct Job job;
+    while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (j_count > 1 && J_Find(j_index, &job))
+            J_Execute(&job);
+    }
+}
+
+/**
+ * Run a function over a range split across the threads, and wait for it
+ *
+ * @count : size of the range
+ * @grain : most of the range given to one job
+ * @func  : what to run on each part
+ * @data  : passed to func
+ *
+ * The parts can run in any order and on any thread, so they must not
+ * touch anything another part does.
+ */
+void
+J_ParallelFor(u32 count, u32 grain, JobFunc *func, void *data)
+{
+    struct JobCounter counter = { 0 };
+    grain = MAX(grain, 1);
+    for (u32 start = 0; start < count; start += grain)
+        J_Spawn(func, data, start, MIN(start + grain, count), &counter);
+    J_Wait(&counter);
+}
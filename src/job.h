@@ -0,0 +1,34 @@
+#ifndef _JOB_h_
+#define _JOB_h_
+
+#include "config.h"
+#include "memory.h"
+
+#define J_MAX_THREADS (16)
+#define J_DEQUE_SIZE  (1024) /* jobs a thread can have queued, power of two */
+#define J_SPIN        (64)   /* failed steals before a worker goes to sleep */
+
+/* a piece of work over the range [start, end) of whatever data is */
+typedef void JobFunc(void *data, u32 start, u32 end);
+
+/* counts jobs still to finish, waited on to join them */
+struct JobCounter {
+    i32 pending;
+};
+
+struct Job {
+    JobFunc           *func;
+    void              *data;
+    u32                start;
+    u32                end;
+    struct JobCounter *counter;
+};
+
+void J_StartJobs(u32 count, struct Stack **scratch);
+void J_StopJobs(void);
+u32  J_ThreadCount(void);
+void J_Spawn(JobFunc *func, void *data, u32 start, u32 end, struct JobCounter *counter);
+void J_Wait(struct JobCounter *counter);
+void J_ParallelFor(u32 count, u32 grain, JobFunc *func, void *data);
+
+#endif
@@ -9,6 +9,140 @@
 #include "config.h"
 #include "main.h"
 
+/* address space reserved for an arena, committed a granule at a time */
+struct Arena {
+    u8  *base;
+    u64  size;
+    u64  granule;
+    u8  *committed; /* one flag per granule */
+    bool hugetlb;   /* explicit huge pages are backed on fault, no mprotect */
+};
+
+#define ARENA_PERM 0
+#define ARENA_TEMP 1
+#define HUGE_PAGE  MEGABYTES(2)
+
+static struct Arena arenas[2];
+static SDL_SpinLock commit_lock;
+static u64         *commit_total;
+
+/**
+ * Commit part of a reserved arena, called by the game as its stacks grow
+ *
+ * @base : start of the range, rounded down to the arena granule
+ * @size : bytes to commit, rounded up to the arena granule
+ *
+ * Ranges are clamped to the arena, and granules that are already
+ * committed are skipped so overlapping requests only count once.
+ */
+static
+COMMIT(CommitMemory) /* base, size */
+{
+    struct Arena *arena = NULL;
+    for (int i = 0; i < 2; i++) {
+        if ((u8 *)base + size > arenas[i].base && (u8 *)base < arenas[i].base + arenas[i].size)
+            arena = &arenas[i];
+    }
+    if (arena == NULL)
+        return false;
+
+    u64 from = MAX((u8 *)base, arena->base) - arena->base;
+    u64 to   = MIN((u8 *)base + size, arena->base + arena->size) - arena->base;
+    from /= arena->granule;
+    to    = (to + arena->granule - 1) / arena->granule;
+
+    bool result = true;
+    SDL_AtomicLock(&commit_lock);
+    for (u64 i = from; i < to && result; i++) {
+        if (arena->committed[i])
+            continue;
+
+        /* grab the whole run of uncommitted granules at once */
+        u64 run = i;
+        while (run < to && !arena->committed[run])
+            run++;
+
+        u8 *start = arena->base + i * arena->granule;
+        u64 bytes = MIN((run - i) * arena->granule, arena->size - i * arena->granule);
+        if (!arena->hugetlb && mprotect(start, bytes, PROT_READ | PROT_WRITE) != 0) {
+            fprintf(stderr, "Couldn't commit memory\n");
+            result = false;
+            break;
+        }
+
+        memset(arena->committed + i, 1, run - i);
+        *commit_total += bytes;
+        i = run;
+    }
+    SDL_AtomicUnlock(&commit_lock);
+
+    return result;
+}
+
+/**
+ * Reserve address space for an arena without committing any of it
+ *
+ * @arena   : arena to set up
+ * @size    : how much address space to reserve
+ * @hugetlb : try explicit huge pages first
+ * @thp     : ask for transparent huge pages
+ * @return  : base of the arena, or NULL
+ *
+ * Anonymous mappings are zero on first touch, so nothing is cleared here.
+ * Huge pages are reserved for the whole arena up front, so when the pool
+ * is too small the mmap fails instead of the first touch faulting.
+ */
+static
+void *
+ReserveArena(struct Arena *arena, u64 size, bool hugetlb, bool thp)
+{
+    u8 *base = MAP_FAILED;
+    arena->hugetlb = false;
+    arena->granule = (hugetlb || thp) ? HUGE_PAGE : Z_COMMIT_GRANULE;
+
+    if (hugetlb) {
+        base = mmap( 0, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+        arena->hugetlb = (base != MAP_FAILED);
+        if (base == MAP_FAILED)
+            fprintf(stderr, "Not enough explicit huge pages, falling back to normal pages\n");
+    }
+
+    if (base == MAP_FAILED)
+        base = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    if (thp && !arena->hugetlb)
+        madvise(base, size, MADV_HUGEPAGE);
+
+    arena->base = base;
+    arena->size = size;
+    arena->committed = calloc((size + arena->granule - 1) / arena->granule, 1);
+    if (arena->committed == NULL) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    return base;
+}
+
+/**
+ * Give back an arena reserved with ReserveArena
+ *
+ * @arena : arena to release
+ */
+static
+void
+ReleaseArena(struct Arena *arena)
+{
+    if (arena->base)
+        munmap(arena->base, arena->size);
+    free(arena->committed);
+    arena->base = NULL;
+    arena->committed = NULL;
+}
+
 enum Event {
     EVENT_OKAY = 0,
     EVENT_FOCUSLOST = 1,
@@ -91,8 +225,13 @@ HandleEvent( SDL_Event *event,
 static
 int
 InitWindowAndRenderer( SDL_Window **window,
-                       SDL_Renderer **renderer )
+                       SDL_Renderer **renderer,
+                       bool headless )
 {
+    /* replays run without a display, through the dummy video driver */
+    if (headless)
+        setenv("SDL_VIDEODRIVER", "dummy", 1);
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         SDL_LOG("Error initializing SDL");
         return -1;
@@ -110,7 +249,8 @@ InitWindowAndRenderer( SDL_Window **window,
         } else {
             *renderer = SDL_CreateRenderer( *window,
                                             -1,
-                                            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
+                                            headless ? SDL_RENDERER_SOFTWARE
+                                                     : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
 
             if (*renderer == NULL) {
                 SDL_LOG("Error creating renderer");
@@ -174,6 +314,189 @@ UnloadGame(struct GameLib *game_lib)
     game_lib->Render = NULL;
 }
 
+/* recorded sessions are this header, then one input record per tick *
+ * until the end of the file. Nothing of the game's memory is saved,   *
+ * a recording starts at launch and a replay starts a fresh game, so   *
+ * the inputs alone bring it to the same state                         */
+#define REPLAY_MAGIC 0x32504c52 /* "RLP2" */
+
+struct ReplayHeader {
+    u32 magic;
+    u32 input_size;   /* sizeof(struct GameInput), rejects other builds */
+};
+
+/**
+ * Start a recording by writing the header
+ *
+ * @file   : file to record into
+ * @return : true on success
+ *
+ * Must be called before the first Update, the recording has to cover
+ * every tick since launch.
+ */
+static
+bool
+RecordBegin(FILE *file)
+{
+    struct ReplayHeader header = { REPLAY_MAGIC, sizeof(struct GameInput) };
+    return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+/**
+ * Record the input for a tick
+ *
+ * @file  : file being recorded into
+ * @last  : the last input recorded, updated to @input
+ * @input : input about to be handed to Update
+ *
+ * A tick whose input didn't change is stored as a single zero byte.
+ */
+static
+void
+RecordInput(FILE *file, struct GameInput *last, struct GameInput *input)
+{
+    u8 changed = memcmp(last, input, sizeof(*input)) != 0;
+    fwrite(&changed, sizeof(changed), 1, file);
+    if (changed) {
+        fwrite(input, sizeof(*input), 1, file);
+        *last = *input;
+    }
+}
+
+/**
+ * Check a recording was made by this build
+ *
+ * @file   : recorded file
+ * @return : true if the recording is usable by this build
+ */
+static
+bool
+ReplayBegin(FILE *file)
+{
+    struct ReplayHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != REPLAY_MAGIC ||
+        header.input_size != sizeof(struct GameInput)) {
+        fprintf(stderr, "Recording doesn't match this build\n");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Read the input for the next recorded tick
+ *
+ * @file   : recorded file
+ * @input  : holds the previous tick's input, replaced if it changed
+ * @return : false once the recording is over
+ */
+static
+bool
+ReplayInput(FILE *file, struct GameInput *input)
+{
+    u8 changed;
+    if (fread(&changed, sizeof(changed), 1, file) != 1)
+        return false;
+    if (changed && fread(input, sizeof(*input), 1, file) != 1)
+        return false;
+    return true;
+}
+
+static
+int
+CompareTicks(const void *a, const void *b)
+{
+    u64 ta = *(const u64 *)a;
+    u64 tb = *(const u64 *)b;
+    return (ta > tb) - (ta < tb);
+}
+
+/**
+ * Push a recording through Update and Render as fast as possible and
+ * print how long it took
+ *
+ * @game_lib : loaded game
+ * @memory   : game memory, untouched since launch
+ * @renderer : renderer to draw into, usually headless
+ * @file     : recording positioned after the header
+ * @hashes   : print the state hash after every tick
+ *
+ * The tick hashes are folded into one, two builds that print the same
+ * one simulated the recording identically. Running out of memory for the
+ * tick times doesn't cut the replay short, so the hash still covers all
+ * of it, only the ticks timed by then go into the percentiles.
+ */
+static
+void
+RunReplay(struct GameLib *game_lib, struct GameMemory *memory, SDL_Renderer *renderer, FILE *file,
+          bool hashes)
+{
+    struct GameInput input = { 0 };
+    const u64 count_ps = SDL_GetPerformanceFrequency();
+
+    u64 capacity = 1024;
+    u64 ticks    = 0;
+    u64 timed    = 0;
+    u64 *times   = malloc(capacity * sizeof(u64));
+    bool timing  = times != NULL;
+    if (!timing)
+        fprintf(stderr, "Couldn't allocate tick times, the replay won't be timed\n");
+
+    u64 hash = 0xcbf29ce484222325ull;
+    memory->hash_state = true;
+
+    u64 start = SDL_GetPerformanceCounter();
+    while (ReplayInput(file, &input)) {
+        u64 tick_start = SDL_GetPerformanceCounter();
+        game_lib->Update(memory, &input);
+        game_lib->Render(memory, renderer, 0.0);
+
+        hash = (hash ^ memory->state_hash) * 0x100000001b3ull;
+        if (hashes)
+            printf("tick %llu hash %016llx\n", (unsigned long long)ticks,
+                   (unsigned long long)memory->state_hash);
+        ticks++;
+
+        u64 elapsed = SDL_GetPerformanceCounter() - tick_start;
+        if (timing && timed == capacity) {
+            /* the old times are still good when the new ones don't fit */
+            u64 *grown = realloc(times, capacity * 2 * sizeof(u64));
+            if (grown) {
+                times     = grown;
+                capacity *= 2;
+            } else {
+                fprintf(stderr, "Couldn't grow tick times, only the first %llu ticks are timed\n",
+                        (unsigned long long)timed);
+                timing = false;
+            }
+        }
+        if (timing)
+            times[timed++] = elapsed;
+    }
+    u64 total = SDL_GetPerformanceCounter() - start;
+
+    /* let the game clean up as if it had been quit */
+    input.quit.was_down = true;
+    game_lib->Update(memory, &input);
+
+    if (ticks > 0) {
+        printf("replay: %llu ticks in %.3f s, %.1f ticks/s\n",
+               (unsigned long long)ticks, (r64)total / (r64)count_ps,
+               (r64)ticks * (r64)count_ps / (r64)total);
+        if (timed > 0) {
+            qsort(times, timed, sizeof(u64), CompareTicks);
+            r64 to_ms = 1000.0 / (r64)count_ps;
+            printf("tick ms: p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+                   times[(timed - 1) * 50 / 100] * to_ms, times[(timed - 1) * 90 / 100] * to_ms,
+                   times[(timed - 1) * 99 / 100] * to_ms, times[timed - 1] * to_ms);
+        }
+        printf("state hash %016llx\n", (unsigned long long)hash);
+    }
+
+    free(times);
+}
+
 int
 main( int argc,
       char **argv )
@@ -181,25 +504,55 @@ main( int argc,
     SDL_Window *window;
     SDL_Renderer *renderer;
 
-    if (InitWindowAndRenderer(&window, &renderer) == 0) {
-        /* preallocate memory to prevent malloc/free usage */
+    /* parse platform options */
+    bool hugetlb = false;
+    bool thp     = false;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *world_path  = CONFIG_WORLD_FILE;
+    bool hashes = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hugetlb") == 0)
+            hugetlb = true;
+        else if (strcmp(argv[i], "--thp") == 0)
+            thp = true;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc)
+            world_path = argv[++i];
+        else if (strcmp(argv[i], "--hashes") == 0)
+            hashes = true;
+    }
+
+    if (InitWindowAndRenderer(&window, &renderer, replay_path != NULL) == 0) {
+        /* reserve memory up front to prevent malloc/free usage, pages are *
+         * only committed as the game's stacks grow into them              */
         struct GameMemory memory = { 0 };
-        memory.perm_memsize = MEGABYTES(64);
-        memory.temp_memsize = MEGABYTES(64);
-        memory.perm_mem = mmap( 0, memory.perm_memsize + memory.temp_memsize, PROT_READ | PROT_WRITE,
-                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
-        if (memory.perm_mem == MAP_FAILED) {
+        memory.perm_memsize = GIGABYTES(4ull);
+        memory.temp_memsize = GIGABYTES(1ull);
+        memory.perm_mem = ReserveArena(&arenas[ARENA_PERM], memory.perm_memsize, hugetlb, thp);
+        memory.temp_mem = ReserveArena(&arenas[ARENA_TEMP], memory.temp_memsize, false, false);
+        memory.Commit   = CommitMemory;
+        commit_total    = &memory.committed;
+
+        /* recordings have to start from the same world every time */
+        memory.world_path = (record_path || replay_path) ? NULL : world_path;
+
+        if (memory.perm_mem == NULL || memory.temp_mem == NULL ||
+            !CommitMemory(memory.perm_mem, Z_COMMIT_GRANULE) ||
+            !CommitMemory(memory.temp_mem, Z_COMMIT_GRANULE)) {
             fprintf(stderr, "Couldn't create memory map\n");
 
+            ReleaseArena(&arenas[ARENA_PERM]);
+            ReleaseArena(&arenas[ARENA_TEMP]);
             SDL_DestroyRenderer(renderer);
             SDL_DestroyWindow(window);
             SDL_Quit();
 
             return 2;
         } else {
-            memset(memory.perm_mem, 0, memory.perm_memsize + memory.temp_memsize);
-            memory.temp_mem = (char *)memory.perm_mem + memory.perm_memsize;
-
             struct GameInput old_input = { 0 };
             struct GameInput new_input = { 0 };
 
@@ -217,6 +570,39 @@ main( int argc,
             struct GameLib game_lib  = { 0 };
             LoadGame(&game_lib);
 
+            /* replays take over completely and exit when done */
+            if (replay_path) {
+                int result = 0;
+                FILE *replay = fopen(replay_path, "rb");
+                if (replay && game_lib.Update && ReplayBegin(replay)) {
+                    RunReplay(&game_lib, &memory, renderer, replay, hashes);
+                } else {
+                    fprintf(stderr, "Couldn't replay %s\n", replay_path);
+                    result = 3;
+                }
+                if (replay)
+                    fclose(replay);
+
+                UnloadGame(&game_lib);
+                ReleaseArena(&arenas[ARENA_PERM]);
+                ReleaseArena(&arenas[ARENA_TEMP]);
+                SDL_DestroyRenderer(renderer);
+                SDL_DestroyWindow(window);
+                SDL_Quit();
+
+                return result;
+            }
+
+            /* recordings start at launch, before the first update */
+            struct GameInput recorded = { 0 };
+            FILE *record = record_path ? fopen(record_path, "wb") : NULL;
+            if (record && !RecordBegin(record)) {
+                fclose(record);
+                record = NULL;
+            }
+            if (record_path && !record)
+                fprintf(stderr, "Couldn't record to %s\n", record_path);
+
             /* loop variables to keep timing right */
             u64 lag             = 0;
             u64 prev_count      = SDL_GetPerformanceCounter();
@@ -264,6 +650,8 @@ main( int argc,
                         new_input.reload_lib = false;
                     }
 
+                    if (record)
+                        RecordInput(record, &recorded, &new_input);
                     if (game_lib.Update)
                         game_lib.Update(&memory, &new_input);
                     lag -= MS_PER_UPDATE*count_pms;
@@ -277,8 +665,19 @@ main( int argc,
                     done = true;
             }
 
+            if (record)
+                fclose(record);
+
+            /* closing the window skips the game's own quit, which stops its *
+             * threads and saves the world, so make sure it has seen one      */
+            new_input.quit.was_down = true;
+            if (game_lib.Update)
+                game_lib.Update(&memory, &new_input);
+
             UnloadGame(&game_lib);
 
+            ReleaseArena(&arenas[ARENA_PERM]);
+            ReleaseArena(&arenas[ARENA_TEMP]);
             SDL_DestroyRenderer(renderer);
             SDL_DestroyWindow(window);
             SDL_Quit();
@@ -2,6 +2,7 @@
 #define _MAIN_h_
 
 #include "config.h"
+#include "memory.h"
 
 /* Consider moving this stuff out to it's own file? */
 typedef struct {
@@ -67,10 +68,22 @@ struct GameInput {
 struct GameMemory {
     bool is_init;
 
+    /* sizes are reserved address space, only the first Z_COMMIT_GRANULE *
+     * of each is committed up front, the rest goes through Commit       */
     u64 perm_memsize;
     void *perm_mem;
     u64 temp_memsize;
     void *temp_mem;
+
+    Commit_t *Commit;
+    u64 committed; /* bytes committed across both, kept by the platform */
+
+    /* world file chunks are paged from, NULL keeps the world in memory */
+    const char *world_path;
+
+    /* set by the platform to have the game hash its state every tick */
+    bool hash_state;
+    u64  state_hash;
 };
 
 #define UPDATE(name) void name(struct GameMemory *memory, struct GameInput *input)
@@ -146,4 +146,119 @@ V3_Hadamard(struct Vec3 a, struct Vec3 b)
     return result;
 }
 
+/* Q16.16 fixed point, the simulation runs on it when built with *
+ * FIXED_POINT so it comes out the same whatever the compiler does */
+typedef i32 fixed;
+
+#define FX_SHIFT    (16)
+#define FX_ONE      (1 << FX_SHIFT)
+#define FX_CONST(f) ((fixed)((f) * FX_ONE)) /* only for constants, folded at compile time */
+
+/**
+ * Convert a float to fixed point, truncating towards zero
+ *
+ * Scaling by a power of two is exact, so this only depends on the float.
+ * Floats under 256 round trip exactly once they're on the fixed grid.
+ */
+static inline
+fixed
+FX_FromR32(r32 f)
+{
+    fixed result = (fixed)(f * (r32)FX_ONE);
+    return result;
+}
+
+static inline
+r32
+FX_ToR32(fixed a)
+{
+    r32 result = (r32)a * (1.0f / FX_ONE);
+    return result;
+}
+
+static inline
+fixed
+FX_Mul(fixed a, fixed b)
+{
+    fixed result = (fixed)(((i64)a * b) >> FX_SHIFT);
+    return result;
+}
+
+static inline
+fixed
+FX_Div(fixed a, fixed b)
+{
+    fixed result = (fixed)(((i64)a << FX_SHIFT) / b);
+    return result;
+}
+
+static inline
+fixed
+FX_Abs(fixed a)
+{
+    fixed result = (a < 0) ? -a : a;
+    return result;
+}
+
+struct FVec2 {
+    fixed x, y;
+};
+
+static inline
+struct FVec2
+FV2_FromV2(struct Vec2 a)
+{
+    struct FVec2 result = { FX_FromR32(a.x), FX_FromR32(a.y) };
+    return result;
+}
+
+static inline
+struct Vec2
+FV2_ToV2(struct FVec2 a)
+{
+    struct Vec2 result = { FX_ToR32(a.x), FX_ToR32(a.y) };
+    return result;
+}
+
+static inline
+struct FVec2
+FV2_Add(struct FVec2 a, struct FVec2 b)
+{
+    struct FVec2 result = { a.x + b.x, a.y + b.y };
+    return result;
+}
+
+static inline
+struct FVec2
+FV2_Sub(struct FVec2 a, struct FVec2 b)
+{
+    struct FVec2 result = { a.x - b.x, a.y - b.y };
+    return result;
+}
+
+static inline
+struct FVec2
+FV2_Mul(fixed f, struct FVec2 a)
+{
+    struct FVec2 result = { FX_Mul(f, a.x), FX_Mul(f, a.y) };
+    return result;
+}
+
+static inline
+fixed
+FV2_Dot(struct FVec2 a, struct FVec2 b)
+{
+    fixed result = (fixed)(((i64)a.x * b.x + (i64)a.y * b.y) >> FX_SHIFT);
+    return result;
+}
+
+/* squared length at double the precision, so small vectors don't vanish */
+static inline
+i64
+FV2_SqLen(struct FVec2 a)
+{
+    i64 result = (i64)a.x * a.x + (i64)a.y * a.y;
+    return result;
+}
+
 #endif
@@ -1,13 +1,47 @@
+#include <stdio.h>
+
 #include "memory.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define Z_SIMD_WIDTH 16
+#else
+typedef u64 __attribute__((may_alias)) z_word;
+#define Z_SIMD_WIDTH sizeof(z_word)
+#endif
+
 struct Stack {
     u8 *base;
     size_t size;
     size_t used;
 
     u32 count;
+    bool atomic; /* bump with atomics so threads can share the stack */
+
+    size_t peak; /* high-water mark of used */
+    struct MemStats tags[MemTag_COUNT];
+
+    /* reserved stacks commit their pages lazily, NULL if always backed */
+    Commit_t *commit;
+    u8       *commit_end;
 };
 
+static const char *z_tag_names[MemTag_COUNT] = {
+    "general",
+    "world",
+    "entity",
+    "nav",
+    "render",
+    "console",
+};
+
+/* scratch stack owned by the calling thread */
+static __thread struct Stack *z_scratch = NULL;
+
+static u8 * Z_Bump(struct Stack *stack, size_t size, size_t align, enum MemTag tag);
+static void Z_StackFull(struct Stack *stack, size_t size);
+static void Z_Commit(struct Stack *stack, u8 *start, u8 *end);
+
 /**
  * Initialize a stack passed in
  *
@@ -22,29 +56,15 @@ void
 Z_InitStack(struct Stack *stack, void *base, size_t size)
 {
     ASSERT(stack);
-    stack->base  = (u8 *)base;
-    stack->size  = size;
-    stack->used  = 0;
-    stack->count = 0;
-}
-
-/**
- * Initialize a slave stack in the master.
- *
- * @slave : stack to initialize
- * @master : initialize within this stack
- * @size : how big the slave should be
- *
- * All should be valid pointers
- */
-static
-void
-Z_InitSubStack(struct Stack *slave, struct Stack *master, size_t size)
-{
-    ASSERT(slave && master);
-    ASSERT(master->used + size <= master->size);
-    Z_InitStack(slave, master->base + master->used, size);
-    master->used += size;
+    stack->base   = (u8 *)base;
+    stack->size   = size;
+    stack->used   = 0;
+    stack->count  = 0;
+    stack->atomic = false;
+    stack->peak   = 0;
+    Z_ZeroArray(stack->tags, MemTag_COUNT);
+    stack->commit     = NULL;
+    stack->commit_end = NULL;
 }
 
 /**
@@ -69,28 +89,105 @@ Z_NewStack(void *base, size_t size)
  *
  * @master : where the sub stack will exist
  * @size   : how big the sub stack should be
+ * @tag    : what the whole sub stack is charged to in the master
  *
- * The @size should be bigger than a stack
+ * The @size should be bigger than a stack and fit in the master
  */
 struct Stack *
-Z_NewSubStack(struct Stack *master, size_t size)
+Z_NewSubStack(struct Stack *master, size_t size, enum MemTag tag)
 {
     ASSERT(size > sizeof(struct Stack));
-    struct Stack *slave = Z_PushStruct(master, struct Stack, true);
-    Z_InitSubStack(slave, master, size - sizeof(struct Stack));
+    /* one bump for header and contents so an atomic master stays safe, but
+     * only commit the header, the contents get committed as the slave grows */
+    u8 *base = (u8 *)Z_Bump(master, size, 1, tag);
+    if (base == NULL) {
+        Z_StackFull(master, size);
+        return NULL;
+    }
+    if (master->commit)
+        Z_Commit(master, base, base + sizeof(struct Stack));
+
+    struct Stack *slave = (struct Stack *)base;
+    Z_InitStack(slave, base + sizeof(struct Stack), size - sizeof(struct Stack));
+    Z_SetStackCommit(slave, master->commit);
     return slave;
 }
 
+/**
+ * Switch a stack between single threaded and atomic bumping
+ *
+ * @stack  : stack to change
+ * @atomic : whether pushes should be safe from several threads
+ *
+ * Atomic stacks can be pushed onto from any thread without a lock, but
+ * cannot hold local stacks since rewinding would race with other pushes.
+ * Only switch modes while no other thread is using the stack.
+ */
+void
+Z_SetStackAtomic(struct Stack *stack, bool atomic)
+{
+    ASSERT(stack);
+    ASSERT(stack->count == 0);
+    stack->atomic = atomic;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * Have a stack commit its pages through the platform as it grows
+ *
+ * @stack  : stack living in reserved address space
+ * @commit : platform hook, NULL if the memory is always backed
+ *
+ * The stack header itself must already be committed.
+ */
+void
+Z_SetStackCommit(struct Stack *stack, Commit_t *commit)
+{
+    ASSERT(stack);
+    stack->commit     = commit;
+    stack->commit_end = stack->base;
+}
+
+/**
+ * Set the scratch stack for the calling thread
+ *
+ * @stack : stack only this thread will push onto, or NULL
+ */
+void
+Z_BindScratchStack(struct Stack *stack)
+{
+    z_scratch = stack;
+}
+
+/**
+ * Get the scratch stack of the calling thread
+ *
+ * @return : stack bound with Z_BindScratchStack
+ *
+ * Scope uses with Z_BeginLocalStack/Z_EndLocalStack like any other stack.
+ */
+struct Stack *
+Z_ScratchStack(void)
+{
+    ASSERT(z_scratch);
+    return z_scratch;
+}
+
 /**
  * Clear the contents of a stack
  *
  * @stack : what to clear
+ *
+ * High-water marks and allocation counts are kept.
  */
 void
 Z_ClearStack(struct Stack *stack)
 {
     ASSERT(stack);
-    Z_InitStack(stack, stack->base, stack->size);
+    stack->used  = 0;
+    stack->count = 0;
+    for (int i = 0; i < MemTag_COUNT; i++)
+        stack->tags[i].bytes = 0;
 }
 
 /**
@@ -102,10 +199,112 @@ size_t
 Z_RemainingStack(struct Stack *stack)
 {
     ASSERT(stack);
-    size_t result = stack->size - stack->used;
+    size_t result = stack->size - __atomic_load_n(&stack->used, __ATOMIC_RELAXED);
     return result;
 }
 
+/**
+ * Get how big a stack is in total
+ *
+ * @stack : what to check
+ */
+size_t
+Z_StackSize(struct Stack *stack)
+{
+    ASSERT(stack);
+    return stack->size;
+}
+
+/**
+ * Get the most a stack has ever had in use
+ *
+ * @stack : what to check
+ */
+size_t
+Z_StackPeak(struct Stack *stack)
+{
+    ASSERT(stack);
+    return __atomic_load_n(&stack->peak, __ATOMIC_RELAXED);
+}
+
+/**
+ * Get the accounting for one tag of a stack
+ *
+ * @stack : what to check
+ * @tag   : which subsystem
+ */
+struct MemStats
+Z_TagStats(struct Stack *stack, enum MemTag tag)
+{
+    ASSERT(stack && tag < MemTag_COUNT);
+    struct MemStats result;
+    result.bytes = __atomic_load_n(&stack->tags[tag].bytes, __ATOMIC_RELAXED);
+    result.peak  = __atomic_load_n(&stack->tags[tag].peak, __ATOMIC_RELAXED);
+    result.count = __atomic_load_n(&stack->tags[tag].count, __ATOMIC_RELAXED);
+    return result;
+}
+
+/**
+ * Get a printable name for a tag
+ *
+ * @tag : which subsystem
+ */
+const char *
+Z_TagName(enum MemTag tag)
+{
+    ASSERT(tag < MemTag_COUNT);
+    return z_tag_names[tag];
+}
+
+/**
+ * Raise a high-water mark if the value went over it
+ *
+ * @peak  : high-water mark to raise
+ * @value : the newly reached value
+ * @sync  : whether other threads might be raising it too
+ */
+static inline
+void
+Z_RaisePeak(size_t *peak, size_t value, bool sync)
+{
+    if (!sync) {
+        *peak = MAX(*peak, value);
+        return;
+    }
+
+    size_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (old < value &&
+           !__atomic_compare_exchange_n(peak, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        /* old reloaded by the failed exchange */;
+}
+
+/**
+ * Charge an allocation to a tag of the stack
+ *
+ * @stack : stack that was pushed onto
+ * @tag   : subsystem to charge
+ * @size  : bytes taken including padding
+ * @end   : used after the push
+ */
+static inline
+void
+Z_Charge(struct Stack *stack, enum MemTag tag, size_t size, size_t end)
+{
+    ASSERT(tag < MemTag_COUNT);
+    struct MemStats *stats = &stack->tags[tag];
+    if (!stack->atomic) {
+        stats->bytes += size;
+        stats->count++;
+        Z_RaisePeak(&stats->peak, stats->bytes, false);
+        Z_RaisePeak(&stack->peak, end, false);
+    } else {
+        size_t bytes = __atomic_add_fetch(&stats->bytes, size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->count, 1, __ATOMIC_RELAXED);
+        Z_RaisePeak(&stats->peak, bytes, true);
+        Z_RaisePeak(&stack->peak, end, true);
+    }
+}
+
 /**
  * Initialize a local stack within the stack
  *
@@ -116,8 +315,11 @@ void
 Z_BeginLocalStack(struct LocalStack *lstack, struct Stack *stack)
 {
     ASSERT(lstack && stack);
+    ASSERT(!stack->atomic);
     lstack->stack = stack;
     lstack->used  = stack->used;
+    for (int i = 0; i < MemTag_COUNT; i++)
+        lstack->tag_bytes[i] = stack->tags[i].bytes;
     stack->count++;
 }
 
@@ -135,11 +337,61 @@ Z_EndLocalStack(struct LocalStack *lstack)
     /* problem if locally removed more than started with */
     ASSERT(stack->used >= lstack->used);
     stack->used = lstack->used;
+    for (int i = 0; i < MemTag_COUNT; i++)
+        stack->tags[i].bytes = lstack->tag_bytes[i];
 
     ASSERT(stack->count > 0);
     stack->count--;
 }
 
+/**
+ * Fill a chunk of memory with a byte value
+ *
+ * @base  : memory to start at
+ * @value : byte to write everywhere
+ * @size  : how much should be filled
+ *
+ * Walks bytes only until the destination is aligned, then writes a full
+ * SIMD register at a time, four registers per iteration.
+ */
+void
+Z_FillSize(void *base, u8 value, size_t size)
+{
+    u8 *byte = (u8 *)base;
+
+    while (size > 0 && ((uptr)byte & (Z_SIMD_WIDTH - 1))) {
+        *(byte++) = value;
+        size--;
+    }
+
+#if defined(__SSE2__)
+    __m128i wide = _mm_set1_epi8((char)value);
+    while (size >= 4*Z_SIMD_WIDTH) {
+        _mm_store_si128((__m128i *)byte + 0, wide);
+        _mm_store_si128((__m128i *)byte + 1, wide);
+        _mm_store_si128((__m128i *)byte + 2, wide);
+        _mm_store_si128((__m128i *)byte + 3, wide);
+        byte += 4*Z_SIMD_WIDTH;
+        size -= 4*Z_SIMD_WIDTH;
+    }
+    while (size >= Z_SIMD_WIDTH) {
+        _mm_store_si128((__m128i *)byte, wide);
+        byte += Z_SIMD_WIDTH;
+        size -= Z_SIMD_WIDTH;
+    }
+#else
+    z_word wide = (z_word)0x0101010101010101ull * value;
+    while (size >= Z_SIMD_WIDTH) {
+        *(z_word *)byte = wide;
+        byte += Z_SIMD_WIDTH;
+        size -= Z_SIMD_WIDTH;
+    }
+#endif
+
+    while (size--)
+        *(byte++) = value;
+}
+
 /**
  * Zero a chunk of memory
  *
@@ -151,28 +403,176 @@ Z_EndLocalStack(struct LocalStack *lstack)
 void
 Z_ZeroSize(void *base, size_t size)
 {
-    char *byte = (char *)base;
+    Z_FillSize(base, 0, size);
+}
+
+/**
+ * Copy a chunk of memory
+ *
+ * @dest : where to copy to
+ * @src  : where to copy from
+ * @size : how many bytes to copy
+ *
+ * The two areas must not overlap. Stores are aligned on @dest, loads from
+ * @src are unaligned since the two rarely share an alignment.
+ */
+void
+Z_CopySize(void *dest, void *src, size_t size)
+{
+    u8 *bdest = (u8 *)dest;
+    u8 *bsrc  = (u8 *)src;
+
+    while (size > 0 && ((uptr)bdest & (Z_SIMD_WIDTH - 1))) {
+        *(bdest++) = *(bsrc++);
+        size--;
+    }
+
+#if defined(__SSE2__)
+    while (size >= 4*Z_SIMD_WIDTH) {
+        __m128i a = _mm_loadu_si128((__m128i *)bsrc + 0);
+        __m128i b = _mm_loadu_si128((__m128i *)bsrc + 1);
+        __m128i c = _mm_loadu_si128((__m128i *)bsrc + 2);
+        __m128i d = _mm_loadu_si128((__m128i *)bsrc + 3);
+        _mm_store_si128((__m128i *)bdest + 0, a);
+        _mm_store_si128((__m128i *)bdest + 1, b);
+        _mm_store_si128((__m128i *)bdest + 2, c);
+        _mm_store_si128((__m128i *)bdest + 3, d);
+        bdest += 4*Z_SIMD_WIDTH;
+        bsrc  += 4*Z_SIMD_WIDTH;
+        size  -= 4*Z_SIMD_WIDTH;
+    }
+    while (size >= Z_SIMD_WIDTH) {
+        _mm_store_si128((__m128i *)bdest, _mm_loadu_si128((__m128i *)bsrc));
+        bdest += Z_SIMD_WIDTH;
+        bsrc  += Z_SIMD_WIDTH;
+        size  -= Z_SIMD_WIDTH;
+    }
+#else
+    while (size >= Z_SIMD_WIDTH) {
+        *(z_word *)bdest = *(z_word *)bsrc;
+        bdest += Z_SIMD_WIDTH;
+        bsrc  += Z_SIMD_WIDTH;
+        size  -= Z_SIMD_WIDTH;
+    }
+#endif
+
     while (size--)
-        *(byte++) = 0;
+        *(bdest++) = *(bsrc++);
 }
 
 /**
- * Allocate an amount of memory onto the stack
+ * Report a push the stack has no room for
+ *
+ * @stack : stack that ran out
+ * @size  : how big the push was
+ *
+ * Only for pushes that can't fail, so this asserts in debug builds.
+ */
+static
+void
+Z_StackFull(struct Stack *stack, size_t size)
+{
+    fprintf(stderr, "Out of stack memory, %zu bytes wanted with %zu of %zu used\n",
+            size, __atomic_load_n(&stack->used, __ATOMIC_RELAXED), stack->size);
+    ASSERT(!"out of stack memory");
+}
+
+/**
+ * Take memory off the stack without touching it
  *
  * @stack : where to allocate
  * @size  : how big the chunk should be
- * @clear : Whether or not to set everything to 0
- * 
- * @return : pointer to the memory that was allocated
+ * @align : power of two the address should be a multiple of
+ * @tag   : subsystem the memory is charged to
+ *
+ * @return : pointer to the memory, which may not be committed yet, NULL
+ *           if the stack doesn't have room left
+ *
+ * The room is checked before the bump is made, so a full stack is left
+ * as it was.
  */
-void *
-Z_PushSize_(struct Stack *stack, size_t size, bool clear)
+static
+u8 *
+Z_Bump(struct Stack *stack, size_t size, size_t align, enum MemTag tag)
 {
     ASSERT(stack);
-    ASSERT((stack->used + size) <= stack->size);
+    ASSERT(align > 0 && (align & (align - 1)) == 0);
+
+    size_t used, pad;
+    if (!stack->atomic) {
+        used = stack->used;
+        pad  = (align - ((uptr)(stack->base + used) & (align - 1))) & (align - 1);
+        if (pad + size > stack->size - used)
+            return NULL;
+        stack->used = used + pad + size;
+    } else {
+        /* padding depends on where we land, so retry until nobody raced us */
+        used = __atomic_load_n(&stack->used, __ATOMIC_RELAXED);
+        do {
+            pad = (align - ((uptr)(stack->base + used) & (align - 1))) & (align - 1);
+            if (pad + size > stack->size - used)
+                return NULL;
+        } while (!__atomic_compare_exchange_n(&stack->used, &used, used + pad + size, true,
+                                              __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+    Z_Charge(stack, tag, pad + size, used + pad + size);
+
+    return stack->base + used + pad;
+}
+
+/**
+ * Make sure a range of the stack is committed
+ *
+ * @stack : stack with a commit hook
+ * @start : first byte that will be touched
+ * @end   : one past the last byte that will be touched
+ *
+ * Everything below commit_end is known to be committed. Past it, whole
+ * granules are committed; the platform ignores granules it already backs,
+ * which also covers threads racing to commit the same range.
+ */
+static
+void
+Z_Commit(struct Stack *stack, u8 *start, u8 *end)
+{
+    u8 *committed = __atomic_load_n(&stack->commit_end, __ATOMIC_ACQUIRE);
+    if (end <= committed)
+        return;
 
-    void *result = stack->base + stack->used;
-    stack->used += size;
+    uptr from = MAX((uptr)start, (uptr)committed) & ~(uptr)(Z_COMMIT_GRANULE - 1);
+    uptr to   = ((uptr)end + Z_COMMIT_GRANULE - 1) & ~(uptr)(Z_COMMIT_GRANULE - 1);
+    if (!stack->commit((void *)from, to - from)) {
+        ASSERT(!"failed to commit stack memory");
+    }
+
+    while (committed < (u8 *)to &&
+           !__atomic_compare_exchange_n(&stack->commit_end, &committed, (u8 *)to, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        /* committed reloaded by the failed exchange */;
+}
+
+/**
+ * Try to allocate an amount of memory onto the stack at a given alignment
+ *
+ * @stack : where to allocate
+ * @size  : how big the chunk should be
+ * @align : power of two the address should be a multiple of
+ * @tag   : subsystem the memory is charged to
+ * @clear : Whether or not to set everything to 0
+ *
+ * @return : pointer to the memory that was allocated, NULL if it didn't fit
+ *
+ * The padding needed to reach @align is consumed from the stack as well.
+ * A push that doesn't fit leaves the stack as it was.
+ */
+void *
+Z_TryPushSizeAligned_(struct Stack *stack, size_t size, size_t align, enum MemTag tag, bool clear)
+{
+    u8 *result = Z_Bump(stack, size, align, tag);
+    if (result == NULL)
+        return NULL;
+    if (stack->commit)
+        Z_Commit(stack, result, result + size);
 
     if (clear)
         Z_ZeroSize(result, size);
@@ -180,30 +580,177 @@ Z_PushSize_(struct Stack *stack, size_t size, bool clear)
     return result;
 }
 
+/**
+ * Try to allocate an amount of memory onto the stack
+ *
+ * @stack : where to allocate
+ * @size  : how big the chunk should be
+ * @tag   : subsystem the memory is charged to
+ * @clear : Whether or not to set everything to 0
+ *
+ * @return : pointer to the memory that was allocated, NULL if it didn't fit
+ */
+void *
+Z_TryPushSize_(struct Stack *stack, size_t size, enum MemTag tag, bool clear)
+{
+    return Z_TryPushSizeAligned_(stack, size, 1, tag, clear);
+}
+
+/**
+ * Allocate an amount of memory onto the stack at a given alignment
+ *
+ * @stack : where to allocate
+ * @size  : how big the chunk should be
+ * @align : power of two the address should be a multiple of
+ * @tag   : subsystem the memory is charged to
+ * @clear : Whether or not to set everything to 0
+ *
+ * @return : pointer to the memory that was allocated
+ *
+ * Running out of room asserts, use Z_TryPushSizeAligned_ to handle it.
+ */
+void *
+Z_PushSizeAligned_(struct Stack *stack, size_t size, size_t align, enum MemTag tag, bool clear)
+{
+    void *result = Z_TryPushSizeAligned_(stack, size, align, tag, clear);
+    if (result == NULL)
+        Z_StackFull(stack, size);
+
+    return result;
+}
+
+/**
+ * Allocate an amount of memory onto the stack
+ *
+ * @stack : where to allocate
+ * @size  : how big the chunk should be
+ * @tag   : subsystem the memory is charged to
+ * @clear : Whether or not to set everything to 0
+ * 
+ * @return : pointer to the memory that was allocated
+ */
+void *
+Z_PushSize_(struct Stack *stack, size_t size, enum MemTag tag, bool clear)
+{
+    return Z_PushSizeAligned_(stack, size, 1, tag, clear);
+}
+
 /**
  * Push memory onto the stack
  *
  * @stack : where to allocate
  * @src   : memory to be pushed onto the stack
  * @size  : how much should be pushed
+ * @tag   : subsystem the memory is charged to
  *
- * @return : pointer to the newly allocated memory
+ * @return : pointer to the newly allocated memory, NULL if it didn't fit
  */
 void *
-Z_PushCopy_(struct Stack *stack, void *src, size_t size)
+Z_PushCopy_(struct Stack *stack, void *src, size_t size, enum MemTag tag)
 {
     ASSERT(src);
-    ASSERT((stack->used + size) <= stack->size);
 
-    void *result = stack->base + stack->used;
-    stack->used += size;
+    void *result = Z_PushSize_(stack, size, tag, false);
+    if (result == NULL)
+        return NULL;
+    Z_CopySize(result, src, size);
 
-    char *dest = (char *)result;
-    char *bsrc = (char *)src;
+    return result;
+}
 
-    while (size--)
-        *(dest++) = *(bsrc++);
+/**
+ * Initialize a pool of fixed size elements
+ *
+ * @pool       : pool to initialize
+ * @stack      : where slabs get carved from
+ * @size       : size of a single element
+ * @slab_count : how many elements to carve at once
+ * @tag        : subsystem the slabs are charged to
+ *
+ * Nothing is carved until the first allocation. Elements are rounded up
+ * to 16 bytes so every element keeps the slab alignment.
+ */
+void
+Z_InitPool(struct Pool *pool, struct Stack *stack, size_t size, u32 slab_count, enum MemTag tag)
+{
+    ASSERT(pool && stack);
+    ASSERT(slab_count > 0);
+    pool->stack      = stack;
+    pool->free       = NULL;
+    pool->tag        = tag;
+    pool->elem_size  = (MAX(size, sizeof(struct PoolNode)) + 15) & ~(size_t)15;
+    pool->slab_count = slab_count;
+    pool->used       = 0;
+    pool->capacity   = 0;
+}
+
+/**
+ * Carve a new slab for the pool and thread it onto the free list
+ *
+ * @pool : pool to grow
+ *
+ * @return : false if the stack had no room for another slab
+ *
+ * Elements are pushed in reverse so they come back out in address order.
+ */
+static
+bool
+Z_GrowPool(struct Pool *pool)
+{
+    u8 *slab = (u8 *)Z_PushSizeAligned_(pool->stack, pool->elem_size * pool->slab_count, 16,
+                                          pool->tag, false);
+    if (slab == NULL)
+        return false;
+
+    for (u32 i = pool->slab_count; i > 0; i--) {
+        struct PoolNode *node = (struct PoolNode *)(slab + (i - 1) * pool->elem_size);
+        node->next = pool->free;
+        pool->free = node;
+    }
+
+    pool->capacity += pool->slab_count;
+    return true;
+}
+
+/**
+ * Allocate a single element from the pool
+ *
+ * @pool  : where to allocate
+ * @clear : Whether or not to set everything to 0
+ *
+ * @return : pointer to the element, NULL if the pool couldn't grow
+ */
+void *
+Z_PoolAlloc_(struct Pool *pool, bool clear)
+{
+    ASSERT(pool);
+    if (pool->free == NULL && !Z_GrowPool(pool))
+        return NULL;
+
+    struct PoolNode *result = pool->free;
+    pool->free = result->next;
+    pool->used++;
+
+    if (clear)
+        Z_ZeroSize(result, pool->elem_size);
 
     return result;
 }
 
+/**
+ * Return an element to the pool
+ *
+ * @pool : pool the element was allocated from
+ * @ptr  : element to release
+ */
+void
+Z_PoolFree(struct Pool *pool, void *ptr)
+{
+    ASSERT(pool && ptr);
+    ASSERT(pool->used > 0);
+
+    struct PoolNode *node = (struct PoolNode *)ptr;
+    node->next = pool->free;
+    pool->free = node;
+    pool->used--;
+}
@@ -5,34 +5,112 @@
 
 struct Stack;
 
+/* platform hook making reserved address space usable, returns success */
+#define COMMIT(name) bool name(void *base, size_t size)
+typedef COMMIT(Commit_t);
+
+/* stacks ask the platform to commit at least this much at a time */
+#define Z_COMMIT_GRANULE KILOBYTES(64)
+
+/* subsystem every allocation is charged to */
+enum MemTag {
+    MEM_GENERAL,
+    MEM_WORLD,
+    MEM_ENTITY,
+    MEM_NAV,
+    MEM_RENDER,
+    MEM_CONSOLE,
+    MemTag_COUNT
+};
+
+/* per tag accounting kept by each stack */
+struct MemStats {
+    size_t bytes; /* currently in use */
+    size_t peak;  /* high-water mark of bytes */
+    u64    count; /* allocations made */
+};
+
 struct LocalStack {
     struct Stack *stack;
     size_t used;
+    size_t tag_bytes[MemTag_COUNT];
+};
+
+/* intrusive free list entry, lives inside each free pool element */
+struct PoolNode {
+    struct PoolNode *next;
+};
+
+/* fixed size elements carved out of a stack in slabs */
+struct Pool {
+    struct Stack    *stack;
+    struct PoolNode *free;
+    enum MemTag      tag;
+
+    size_t elem_size;
+    u32    slab_count; /* elements per slab */
+
+    u32    used;       /* elements currently handed out */
+    u32    capacity;   /* elements carved so far */
 };
 
 /* general stacks */
 struct Stack *Z_NewStack(void *base, size_t size);
-struct Stack *Z_NewSubStack(struct Stack *master, size_t size);
+struct Stack *Z_NewSubStack(struct Stack *master, size_t size, enum MemTag tag);
 void          Z_ClearStack(struct Stack *stack);
 size_t        Z_RemainingStack(struct Stack *stack);
+size_t        Z_StackSize(struct Stack *stack);
+size_t        Z_StackPeak(struct Stack *stack);
+void          Z_SetStackAtomic(struct Stack *stack, bool atomic);
+void          Z_SetStackCommit(struct Stack *stack, Commit_t *commit);
+
+/* per thread scratch stacks */
+void          Z_BindScratchStack(struct Stack *stack);
+struct Stack *Z_ScratchStack(void);
+
+/* memory accounting */
+struct MemStats Z_TagStats(struct Stack *stack, enum MemTag tag);
+const char *    Z_TagName(enum MemTag tag);
 
 /* local stack for functions */
 void Z_BeginLocalStack(struct LocalStack *lstack, struct Stack *stack);
 void Z_EndLocalStack(struct LocalStack *lstack);
 
-/* zero areas of memory */
+/* zero, fill and copy areas of memory */
+void    Z_FillSize(void *base, u8 value, size_t size);
 void    Z_ZeroSize(void *base, size_t size);
-#define Z_ZeroStruct(instance)    ZeroSize(&instance, sizeof(instance))
-#define Z_ZeroArray(array, count) ZeroSize((void *)array, sizeof(array[0])*count)
+void    Z_CopySize(void *dest, void *src, size_t size);
+#define Z_ZeroStruct(instance)    Z_ZeroSize(&instance, sizeof(instance))
+#define Z_ZeroArray(array, count) Z_ZeroSize((void *)array, sizeof(array[0])*count)
 
 /* malloc an area of memory */
-void *  Z_PushSize_(struct Stack *stack, size_t size, bool clear);
-#define Z_PushStruct(stack, type, ...)       (type *)Z_PushSize_(stack, sizeof(type), ## __VA_ARGS__ )
-#define Z_PushArray(stack, type, count, ...) (type *)Z_PushSize_(stack, sizeof(type)*count, ## __VA_ARGS__ )
+void *  Z_PushSize_(struct Stack *stack, size_t size, enum MemTag tag, bool clear);
+#define Z_PushStruct(stack, type, tag, ...)       (type *)Z_PushSize_(stack, sizeof(type), tag, ## __VA_ARGS__ )
+#define Z_PushArray(stack, type, count, tag, ...) (type *)Z_PushSize_(stack, sizeof(type)*count, tag, ## __VA_ARGS__ )
+
+/* malloc an area of memory at an alignment (16, 32, 64, ...) */
+#define Z_CACHELINE 64
+void *  Z_PushSizeAligned_(struct Stack *stack, size_t size, size_t align, enum MemTag tag, bool clear);
+#define Z_PushSizeAligned(stack, size, align, tag, ...)          Z_PushSizeAligned_(stack, size, align, tag, ## __VA_ARGS__ )
+#define Z_PushStructAligned(stack, type, align, tag, ...)        (type *)Z_PushSizeAligned_(stack, sizeof(type), align, tag, ## __VA_ARGS__ )
+#define Z_PushArrayAligned(stack, type, count, align, tag, ...)  (type *)Z_PushSizeAligned_(stack, sizeof(type)*count, align, tag, ## __VA_ARGS__ )
+
+/* same as the pushes above, but NULL instead of asserting when it doesn't fit */
+void *  Z_TryPushSize_(struct Stack *stack, size_t size, enum MemTag tag, bool clear);
+void *  Z_TryPushSizeAligned_(struct Stack *stack, size_t size, size_t align, enum MemTag tag, bool clear);
+#define Z_TryPushSize(stack, size, tag, ...)                        Z_TryPushSize_(stack, size, tag, ## __VA_ARGS__ )
+#define Z_TryPushSizeAligned(stack, size, align, tag, ...)          Z_TryPushSizeAligned_(stack, size, align, tag, ## __VA_ARGS__ )
+#define Z_TryPushArrayAligned(stack, type, count, align, tag, ...)  (type *)Z_TryPushSizeAligned_(stack, sizeof(type)*count, align, tag, ## __VA_ARGS__ )
 
 /* push memory onto the stack */
-void *  Z_PushCopy_(struct Stack *stack, void *src, size_t size);
-#define Z_PushCopyStruct(stack, src, type)       (type *)Z_PushCopy_(stack, (void *)src, sizeof(type))
-#define Z_PushCopyArray(stack, src, type, count) (type *)Z_PushCopy_(stack, (void *)src, sizeof(type)*count)
+void *  Z_PushCopy_(struct Stack *stack, void *src, size_t size, enum MemTag tag);
+#define Z_PushCopyStruct(stack, src, type, tag)       (type *)Z_PushCopy_(stack, (void *)src, sizeof(type), tag)
+#define Z_PushCopyArray(stack, src, type, count, tag) (type *)Z_PushCopy_(stack, (void *)src, sizeof(type)*count, tag)
+
+/* fixed size pools */
+void    Z_InitPool(struct Pool *pool, struct Stack *stack, size_t size, u32 slab_count, enum MemTag tag);
+void *  Z_PoolAlloc_(struct Pool *pool, bool clear);
+void    Z_PoolFree(struct Pool *pool, void *ptr);
+#define Z_PoolAllocStruct(pool, type, ...) (type *)Z_PoolAlloc_(pool, ## __VA_ARGS__ )
 
 #endif
@@ -0,0 +1,737 @@
+#include "nav.h"
+#include "world.h"
+
+_Static_assert(N_CHUNK_TILES == W_CHUNK_DIM * W_CHUNK_DIM, "N_CHUNK_TILES must match the chunk size");
+_Static_assert(N_MAX_PORTALS >= NavSide_COUNT * ((W_CHUNK_DIM + 1) / 2), "not enough room for portals");
+
+/* straight steps first, so a tie between a straight and a diagonal step *
+ * goes to the straight one                                             */
+static const i32 N_STEPS[8][2] = {
+    {  1,  0 }, {  0,  1 }, { -1,  0 }, {  0, -1 },
+    {  1,  1 }, { -1,  1 }, { -1, -1 }, {  1, -1 },
+};
+
+/* neighbouring chunk across each side */
+static const i32 N_SIDES[NavSide_COUNT][2] = {
+    [NAV_NORTH] = {  0, -1 },
+    [NAV_SOUTH] = {  0,  1 },
+    [NAV_WEST]  = { -1,  0 },
+    [NAV_EAST]  = {  1,  0 },
+};
+
+/**
+ * Check if a tile of a chunk can be walked on, anything outside isn't
+ */
+static inline
+bool
+N_Walkable(struct WorldChunk *chunk, i32 x, i32 y)
+{
+    return x >= 0 && y >= 0 && x < W_CHUNK_DIM && y < W_CHUNK_DIM &&
+           !W_TILES[chunk->tiles[y * W_CHUNK_DIM + x]].solid;
+}
+
+/**
+ * Check if a step can be taken, diagonals can't cut a corner
+ *
+ * @chunk : chunk the step is in
+ * @x     : tile stepped from
+ * @y     : tile stepped from
+ * @step  : entry of N_STEPS
+ */
+static inline
+bool
+N_CanStep(struct WorldChunk *chunk, i32 x, i32 y, u32 step)
+{
+    i32 dx = N_STEPS[step][0];
+    i32 dy = N_STEPS[step][1];
+    if (!N_Walkable(chunk, x + dx, y + dy))
+        return false;
+    return step < 4 || (N_Walkable(chunk, x + dx, y) && N_Walkable(chunk, x, y + dy));
+}
+
+/**
+ * Work out the cost of the cheapest walk between one tile and every other
+ * tile of a chunk, without leaving the chunk
+ *
+ * @chunk : the chunk
+ * @x     : tile the costs are from
+ * @y     : tile the costs are from
+ * @costs : N_CHUNK_TILES costs filled in, N_NO_PATH where it can't get
+ *
+ * Steps are the same both ways, so the costs are also to the tile. The
+ * heap lives on the stack, a tile is pushed at most once per neighbour.
+ */
+static
+void
+N_LocalCosts(struct WorldChunk *chunk, i32 x, i32 y, u16 *costs)
+{
+    for (u32 i = 0; i < N_CHUNK_TILES; i++)
+        costs[i] = N_NO_PATH;
+    if (!N_Walkable(chunk, x, y))
+        return;
+
+    /* cost above the tile index, so the smallest entry is the cheapest */
+    u32 heap[N_CHUNK_TILES * 8];
+    u32 count = 0;
+    costs[y * W_CHUNK_DIM + x] = 0;
+    heap[count++] = y * W_CHUNK_DIM + x;
+
+    while (count > 0) {
+        u32 top = heap[0];
+        u32 last = heap[--count];
+        u32 i = 0;
+        for (u32 child = 1; child < count; child = 2 * i + 1) {
+            if (child + 1 < count && heap[child + 1] < heap[child])
+                child++;
+            if (last <= heap[child])
+                break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = last;
+
+        u32 cost = top >> 8;
+        u32 tile = top & 0xff;
+        if (cost > costs[tile])
+            continue;
+
+        i32 tx = tile % W_CHUNK_DIM;
+        i32 ty = tile / W_CHUNK_DIM;
+        for (u32 step = 0; step < 8; step++) {
+            if (!N_CanStep(chunk, tx, ty, step))
+                continue;
+
+            u32 next = (ty + N_STEPS[step][1]) * W_CHUNK_DIM + tx + N_STEPS[step][0];
+            u32 next_cost = cost + ((step < 4) ? N_STRAIGHT : N_DIAGONAL);
+            if (next_cost >= costs[next])
+                continue;
+
+            costs[next] = next_cost;
+            u32 entry = (next_cost << 8) | next;
+            u32 j = count++;
+            for (; j > 0 && heap[(j - 1) / 2] > entry; j = (j - 1) / 2)
+                heap[j] = heap[(j - 1) / 2];
+            heap[j] = entry;
+        }
+    }
+}
+
+/**
+ * Find a chunk's portals and the costs between them
+ *
+ * @world : the current world
+ * @chunk : the chunk
+ *
+ * Every run of border tiles with walkable tiles on both sides of the
+ * border is an entrance with a portal in its middle. The neighbour sees
+ * the same runs, so both sides agree on where the portals are. Sides next
+ * to chunks that aren't loaded have none.
+ */
+static
+void
+N_BuildChunk(struct WorldState *world, struct WorldChunk *chunk)
+{
+    struct NavChunk *nav = &chunk->nav;
+    nav->count = 0;
+
+    for (u32 side = 0; side < NavSide_COUNT; side++) {
+        struct WorldChunk *next = W_GetChunk(world, chunk->x + N_SIDES[side][0],
+                                             chunk->y + N_SIDES[side][1], false);
+        if (next == NULL)
+            continue;
+
+        i32 run = -1;
+        for (i32 k = 0; k <= W_CHUNK_DIM; k++) {
+            /* the tile on this side and the one across from it */
+            i32 x  = (side == NAV_WEST) ? 0 : (side == NAV_EAST) ? W_CHUNK_DIM - 1 : k;
+            i32 y  = (side == NAV_NORTH) ? 0 : (side == NAV_SOUTH) ? W_CHUNK_DIM - 1 : k;
+            i32 nx = (side == NAV_WEST || side == NAV_EAST) ? W_CHUNK_DIM - 1 - x : x;
+            i32 ny = (side == NAV_NORTH || side == NAV_SOUTH) ? W_CHUNK_DIM - 1 - y : y;
+
+            bool open = k < W_CHUNK_DIM && N_Walkable(chunk, x, y) && N_Walkable(next, nx, ny);
+            if (open && run < 0) {
+                run = k;
+            } else if (!open && run >= 0) {
+                i32 mid = (run + k - 1) / 2;
+                struct NavPortal *portal = &nav->portals[nav->count++];
+                portal->x    = (side == NAV_WEST || side == NAV_EAST) ? x : mid;
+                portal->y    = (side == NAV_NORTH || side == NAV_SOUTH) ? y : mid;
+                portal->side = side;
+                run = -1;
+            }
+        }
+    }
+
+    u16 costs[N_CHUNK_TILES];
+    for (u32 i = 0; i < nav->count; i++) {
+        N_LocalCosts(chunk, nav->portals[i].x, nav->portals[i].y, costs);
+        for (u32 j = 0; j < nav->count; j++)
+            nav->costs[i][j] = costs[nav->portals[j].y * W_CHUNK_DIM + nav->portals[j].x];
+    }
+
+    nav->valid = true;
+}
+
+/**
+ * Throw away a chunk's part of the graph
+ *
+ * @nav   : the world's navigation
+ * @chunk : the chunk
+ */
+static
+void
+N_Invalidate(struct NavState *nav, struct WorldChunk *chunk)
+{
+    chunk->nav.valid   = false;
+    chunk->nav.version = ++nav->versions;
+
+    /* the running search may hold on to the chunk or its portals */
+    if (nav->active && (chunk->nav.search == nav->search || chunk == nav->goal_chunk))
+        nav->restart = true;
+}
+
+/**
+ * Throw away a chunk's part of the graph and the parts of its neighbours,
+ * for when its walls change or it's loaded or removed
+ *
+ * @world : the current world
+ * @chunk : the chunk
+ *
+ * Nothing is rebuilt until a search needs it. Paths through the chunk are
+ * checked on the next update.
+ */
+void
+N_InvalidateChunk(struct WorldState *world, struct WorldChunk *chunk)
+{
+    N_Invalidate(&world->nav, chunk);
+    chunk->nav.walls = chunk->nav.version;
+    for (u32 side = 0; side < NavSide_COUNT; side++) {
+        struct WorldChunk *next = W_GetChunk(world, chunk->x + N_SIDES[side][0],
+                                             chunk->y + N_SIDES[side][1], false);
+        if (next != NULL)
+            N_Invalidate(&world->nav, next);
+    }
+}
+
+/**
+ * Get a lower bound on the cost between two tiles
+ */
+static inline
+u32
+N_Estimate(struct WorldChunk *chunk, u32 x, u32 y, struct NavPoint *goal)
+{
+    i64 dx = ((i64)chunk->x - goal->cx) * W_CHUNK_DIM + (i64)x - goal->x;
+    i64 dy = ((i64)chunk->y - goal->cy) * W_CHUNK_DIM + (i64)y - goal->y;
+    dx = MAX(dx, -dx);
+    dy = MAX(dy, -dy);
+    i64 result = N_STRAIGHT * MAX(dx, dy) + (N_DIAGONAL - N_STRAIGHT) * MIN(dx, dy);
+    return (u32)MIN(result, (i64)UINT32_MAX / 2);
+}
+
+/**
+ * Reach a portal with some cost, queueing it if that's the cheapest yet
+ *
+ * @world       : the current world
+ * @chunk       : chunk of the portal
+ * @portal      : the portal
+ * @g           : cost from the start
+ * @from_chunk  : node it was reached from, NULL for the start
+ * @from_portal : node it was reached from
+ *
+ * The open list grows on the world stack, old ones are left there.
+ */
+static
+void
+N_Relax(struct WorldState *world, struct WorldChunk *chunk, u32 portal, u32 g,
+        struct WorldChunk *from_chunk, u32 from_portal)
+{
+    struct NavState *nav = &world->nav;
+    struct NavChunk *node = &chunk->nav;
+    if (node->search != nav->search) {
+        node->search = nav->search;
+        for (u32 i = 0; i < N_MAX_PORTALS; i++)
+            node->g[i] = UINT32_MAX;
+    }
+    if (g >= node->g[portal])
+        return;
+
+    node->g[portal]           = g;
+    node->from_chunk[portal]  = from_chunk;
+    node->from_portal[portal] = from_portal;
+
+    if (nav->open_count == nav->open_capacity) {
+        u32 capacity = MAX(nav->open_capacity * 2, N_AGENTS_MIN * N_MAX_PORTALS);
+        struct NavNode *open = Z_PushArrayAligned(world->stack, struct NavNode, capacity,
+                                                  Z_CACHELINE, MEM_NAV, false);
+        if (nav->open != NULL)
+            Z_CopySize(open, nav->open, nav->open_count * sizeof(struct NavNode));
+        nav->open          = open;
+        nav->open_capacity = capacity;
+    }
+
+    struct NavAgent *agent = &nav->agents[nav->active - 1];
+    struct NavNode entry = {
+        g + N_Estimate(chunk, node->portals[portal].x, node->portals[portal].y, &agent->goal),
+        g, chunk, portal
+    };
+    u32 i = nav->open_count++;
+    for (; i > 0 && nav->open[(i - 1) / 2].f > entry.f; i = (i - 1) / 2)
+        nav->open[i] = nav->open[(i - 1) / 2];
+    nav->open[i] = entry;
+}
+
+/**
+ * Take the cheapest node off the open list
+ */
+static
+struct NavNode
+N_PopOpen(struct NavState *nav)
+{
+    struct NavNode result = nav->open[0];
+    struct NavNode last = nav->open[--nav->open_count];
+    u32 i = 0;
+    for (u32 child = 1; child < nav->open_count; child = 2 * i + 1) {
+        if (child + 1 < nav->open_count && nav->open[child + 1].f < nav->open[child].f)
+            child++;
+        if (last.f <= nav->open[child].f)
+            break;
+        nav->open[i] = nav->open[child];
+        i = child;
+    }
+    nav->open[i] = last;
+    return result;
+}
+
+/**
+ * Get the tile an entity stands on
+ */
+static inline
+void
+N_EntityTile(struct EntityRef *ref, i32 *x, i32 *y)
+{
+    struct Vec2 pos = E_TABLE(ref)->pos[ref->row];
+    *x = MIN(MAX((i32)pos.x, 0), W_CHUNK_DIM - 1);
+    *y = MIN(MAX((i32)pos.y, 0), W_CHUNK_DIM - 1);
+}
+
+/**
+ * Start the search for an agent's path from wherever its npc is now
+ *
+ * @world  : the current world
+ * @budget : nodes left to expand this tick
+ *
+ * The start and the goal aren't nodes, the start's costs to the portals
+ * of its chunk are worked out here and the goal's costs from the portals
+ * of its chunk are kept for as long as the goal stays the same.
+ */
+static
+void
+N_BeginSearch(struct WorldState *world, u32 *budget)
+{
+    struct NavState *nav = &world->nav;
+    struct NavAgent *agent = &nav->agents[nav->active - 1];
+
+    nav->search      = MAX(nav->search + 1, 1);
+    nav->restart     = false;
+    nav->open_count  = 0;
+    nav->best        = UINT32_MAX;
+    nav->best_chunk  = NULL;
+    nav->best_portal = 0;
+    nav->goal_chunk  = W_GetChunk(world, agent->goal.cx, agent->goal.cy, false);
+
+    struct EntityRef ref;
+    E_GetEntity(world, agent->handle, &ref);
+    if (nav->goal_chunk == NULL)
+        return;
+
+    struct WorldChunk *start = ref.chunk;
+    struct WorldChunk *goal  = nav->goal_chunk;
+    if (!start->nav.valid) {
+        N_BuildChunk(world, start);
+        *budget -= MIN(*budget, start->nav.count);
+    }
+    if (!goal->nav.valid) {
+        N_BuildChunk(world, goal);
+        *budget -= MIN(*budget, goal->nav.count);
+    }
+
+    if (!nav->goal_valid || nav->goal_version != goal->nav.version ||
+        memcmp(&nav->goal, &agent->goal, sizeof(struct NavPoint)) != 0) {
+        N_LocalCosts(goal, agent->goal.x, agent->goal.y, nav->goal_costs);
+        nav->goal         = agent->goal;
+        nav->goal_version = goal->nav.version;
+        nav->goal_valid   = true;
+    }
+
+    i32 x, y;
+    N_EntityTile(&ref, &x, &y);
+    if (start == goal && nav->goal_costs[y * W_CHUNK_DIM + x] != N_NO_PATH)
+        nav->best = nav->goal_costs[y * W_CHUNK_DIM + x];
+
+    u16 costs[N_CHUNK_TILES];
+    N_LocalCosts(start, x, y, costs);
+    for (u32 i = 0; i < start->nav.count; i++) {
+        u16 cost = costs[start->nav.portals[i].y * W_CHUNK_DIM + start->nav.portals[i].x];
+        if (cost != N_NO_PATH)
+            N_Relax(world, start, i, cost, NULL, 0);
+    }
+}
+
+/**
+ * Hand the agent of the finished search its path
+ *
+ * @world : the current world
+ *
+ * Paths through more portals than an agent holds are cut short, the agent
+ * searches again from where the first part left it.
+ */
+static
+void
+N_FinishSearch(struct WorldState *world)
+{
+    struct NavState *nav = &world->nav;
+    struct NavAgent *agent = &nav->agents[nav->active - 1];
+    nav->active = 0;
+
+    if (nav->best == UINT32_MAX) {
+        agent->status = NAV_DONE;
+        nav->failed++;
+        return;
+    }
+
+    /* walk back to the start, keeping the portals nearest it */
+    u32 total = 0;
+    struct WorldChunk *chunk = nav->best_chunk;
+    u32 portal = nav->best_portal;
+    for (; chunk != NULL; total++) {
+        struct WorldChunk *from = chunk->nav.from_chunk[portal];
+        portal = chunk->nav.from_portal[portal];
+        chunk = from;
+    }
+
+    u32 count = MIN(total, N_MAX_WAYPOINTS - 1);
+    chunk  = nav->best_chunk;
+    portal = nav->best_portal;
+    for (u32 i = total; chunk != NULL; i--) {
+        if (i - 1 < count) {
+            struct NavPortal *p = &chunk->nav.portals[portal];
+            agent->waypoints[i - 1] = (struct NavPoint){ chunk->x, chunk->y, p->x, p->y };
+        }
+        struct WorldChunk *from = chunk->nav.from_chunk[portal];
+        portal = chunk->nav.from_portal[portal];
+        chunk = from;
+    }
+    if (count == total)
+        agent->waypoints[count++] = agent->goal;
+
+    agent->count   = count;
+    agent->next    = 0;
+    agent->checked = nav->versions;
+    agent->leg     = 0;
+    agent->status  = NAV_FOLLOWING;
+    nav->found++;
+}
+
+/**
+ * Carry on with the running search
+ *
+ * @world  : the current world
+ * @budget : nodes left to expand this tick, counted down
+ * @return : true if it finished
+ *
+ * Plain A* over the portals, the first node no cheaper than the best way
+ * to the goal found so far ends it. Chunks the search runs into are built
+ * as it goes, which comes out of the budget too.
+ */
+static
+bool
+N_Search(struct WorldState *world, u32 *budget)
+{
+    struct NavState *nav = &world->nav;
+    if (nav->restart)
+        N_BeginSearch(world, budget);
+
+    while (nav->open_count > 0) {
+        if (*budget == 0)
+            return false;
+        (*budget)--;
+        nav->expanded++;
+
+        struct NavNode node = N_PopOpen(nav);
+        if (node.f >= nav->best)
+            break;
+
+        struct NavChunk *chunk = &node.chunk->nav;
+        if (node.g > chunk->g[node.portal])
+            continue;
+
+        struct NavPortal *portal = &chunk->portals[node.portal];
+        if (node.chunk == nav->goal_chunk) {
+            u16 cost = nav->goal_costs[portal->y * W_CHUNK_DIM + portal->x];
+            if (cost != N_NO_PATH && node.g + cost < nav->best) {
+                nav->best        = node.g + cost;
+                nav->best_chunk  = node.chunk;
+                nav->best_portal = node.portal;
+            }
+        }
+
+        for (u32 i = 0; i < chunk->count; i++) {
+            if (i != node.portal && chunk->costs[node.portal][i] != N_NO_PATH)
+                N_Relax(world, node.chunk, i, node.g + chunk->costs[node.portal][i], node.chunk, node.portal);
+        }
+
+        /* step across to the portal facing this one */
+        struct WorldChunk *next = W_GetChunk(world, node.chunk->x + N_SIDES[portal->side][0],
+                                             node.chunk->y + N_SIDES[portal->side][1], false);
+        if (next == NULL)
+            continue;
+        if (!next->nav.valid) {
+            N_BuildChunk(world, next);
+            *budget -= MIN(*budget, next->nav.count);
+        }
+
+        u32 x = (portal->side == NAV_WEST || portal->side == NAV_EAST) ? W_CHUNK_DIM - 1 - portal->x : portal->x;
+        u32 y = (portal->side == NAV_NORTH || portal->side == NAV_SOUTH) ? W_CHUNK_DIM - 1 - portal->y : portal->y;
+        for (u32 i = 0; i < next->nav.count; i++) {
+            struct NavPortal *across = &next->nav.portals[i];
+            if (across->side == (portal->side ^ 1) && across->x == x && across->y == y) {
+                N_Relax(world, next, i, node.g + N_STRAIGHT, node.chunk, node.portal);
+                break;
+            }
+        }
+    }
+
+    N_FinishSearch(world);
+    return true;
+}
+
+/**
+ * Check that the rest of a path still goes through loaded chunks whose
+ * walls haven't changed since it was found
+ *
+ * @world  : the current world
+ * @agent  : agent on the path
+ * @return : false if it has to be searched for again
+ */
+static
+bool
+N_CheckPath(struct WorldState *world, struct NavAgent *agent)
+{
+    struct WorldChunk *chunk = NULL;
+    for (u32 i = agent->next; i < agent->count; i++) {
+        struct NavPoint *point = &agent->waypoints[i];
+        if (chunk == NULL || chunk->x != point->cx || chunk->y != point->cy) {
+            chunk = W_GetChunk(world, point->cx, point->cy, false);
+            if (chunk == NULL || chunk->nav.walls > agent->checked)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Ask for an npc to find its way somewhere
+ *
+ * @world  : the current world
+ * @handle : the npc, which should wander
+ * @goal   : where to
+ * @return : false if the npc is gone
+ *
+ * The path is searched for over the next few updates, the npc stands
+ * still until then. Asking again replaces the goal.
+ * Old agent arrays are left on the world stack, like the entity slots'.
+ */
+bool
+N_RequestPath(struct WorldState *world, struct EntityHandle handle, struct NavPoint goal)
+{
+    struct EntityRef ref;
+    if (!E_GetEntity(world, handle, &ref))
+        return false;
+
+    struct NavState *nav = &world->nav;
+    struct EntitySlot *slot = &world->slots[handle.index];
+    if (slot->nav == 0) {
+        if (nav->count == nav->capacity) {
+            u32 capacity = MAX(nav->capacity * 2, N_AGENTS_MIN);
+            struct NavAgent *agents = Z_PushArrayAligned(world->stack, struct NavAgent, capacity,
+                                                         Z_CACHELINE, MEM_NAV, false);
+            if (nav->agents != NULL)
+                Z_CopySize(agents, nav->agents, nav->count * sizeof(struct NavAgent));
+            nav->agents   = agents;
+            nav->capacity = capacity;
+        }
+        slot->nav = ++nav->count;
+        nav->agents[slot->nav - 1].handle = handle;
+    }
+
+    if (nav->active == slot->nav)
+        nav->restart = true;
+
+    struct NavAgent *agent = &nav->agents[slot->nav - 1];
+    agent->status = NAV_QUEUED;
+    agent->goal   = goal;
+    agent->count  = 0;
+    agent->next   = 0;
+    agent->leg    = 0;
+    return true;
+}
+
+/**
+ * Let go of agents that are done, then search for paths until the budget
+ * runs out
+ *
+ * @world : the current world
+ *
+ * Paths that went through a chunk that changed since are searched for
+ * again. Searches take turns in the order they were asked for, and one
+ * that runs out of budget carries on next update. The budget counts nodes rather
+ * than time so replays stay deterministic.
+ */
+void
+N_UpdatePaths(struct WorldState *world)
+{
+    struct NavState *nav = &world->nav;
+    for (u32 i = 0; i < nav->count;) {
+        struct NavAgent *agent = &nav->agents[i];
+        struct EntityRef ref;
+        bool alive = E_GetEntity(world, agent->handle, &ref) && world->slots[agent->handle.index].nav == i + 1;
+        if (alive && agent->status != NAV_DONE) {
+            if (agent->status == NAV_FOLLOWING && agent->checked != nav->versions) {
+                if (N_CheckPath(world, agent))
+                    agent->checked = nav->versions;
+                else
+                    agent->status = NAV_QUEUED;
+            }
+            i++;
+            continue;
+        }
+
+        if (alive)
+            world->slots[agent->handle.index].nav = 0;
+        if (nav->active == i + 1)
+            nav->active = 0;
+
+        /* swap the last one in */
+        u32 last = --nav->count;
+        if (i != last) {
+            *agent = nav->agents[last];
+            if (E_GetEntity(world, agent->handle, &ref) && world->slots[agent->handle.index].nav == last + 1)
+                world->slots[agent->handle.index].nav = i + 1;
+            if (nav->active == last + 1)
+                nav->active = i + 1;
+        }
+    }
+
+    u32 budget = N_BUDGET;
+    nav->expanded = 0;
+    while (budget > 0) {
+        if (nav->active == 0) {
+            u32 n = 0;
+            for (; n < nav->count; n++) {
+                u32 i = (nav->cursor + n) % nav->count;
+                if (nav->agents[i].status == NAV_QUEUED) {
+                    nav->active = i + 1;
+                    nav->cursor = i + 1;
+                    break;
+                }
+            }
+            if (nav->active == 0)
+                break;
+            N_BeginSearch(world, &budget);
+        }
+        if (!N_Search(world, &budget))
+            break;
+    }
+}
+
+/**
+ * Pick the direction an npc on a path heads in
+ *
+ * @world  : the current world
+ * @ref    : the npc
+ * @dir    : filled in with one of the eight wander directions, 8 to stand
+ * @return : false if it isn't on a path
+ *
+ * Within a chunk the costs to the next waypoint are worked out once and
+ * the npc walks down them a tile at a time. If it ends up somewhere it
+ * can't get on from it searches again. Only reads the npc's own chunk and
+ * writes its own agent, so npcs can be steered side by side.
+ */
+bool
+N_Steer(struct WorldState *world, struct EntityRef *ref, u32 *dir)
+{
+    /* wander direction by the sign of each axis */
+    static const u32 directions[3][3] = {
+        { 5, 6, 7 },
+        { 4, 8, 0 },
+        { 3, 2, 1 },
+    };
+
+    struct EntityTable *table = E_TABLE(ref);
+    u32 index = world->slots[table->id[ref->row]].nav;
+    if (index == 0)
+        return false;
+
+    struct NavAgent *agent = &world->nav.agents[index - 1];
+    struct WorldChunk *chunk = ref->chunk;
+    *dir = 8;
+    if (agent->status != NAV_FOLLOWING)
+        return true;
+
+    i32 x, y;
+    N_EntityTile(ref, &x, &y);
+    while (agent->next < agent->count) {
+        struct NavPoint *point = &agent->waypoints[agent->next];
+        if (point->cx != chunk->x || point->cy != chunk->y || point->x != x || point->y != y)
+            break;
+        agent->next++;
+    }
+    if (agent->next == agent->count) {
+        bool arrived = memcmp(&agent->waypoints[agent->count - 1], &agent->goal, sizeof(struct NavPoint)) == 0;
+        agent->status = arrived ? NAV_DONE : NAV_QUEUED;
+        return true;
+    }
+
+    struct NavPoint *point = &agent->waypoints[agent->next];
+    i32 to_x = (i32)(point->cx - chunk->x) * W_CHUNK_DIM + point->x;
+    i32 to_y = (i32)(point->cy - chunk->y) * W_CHUNK_DIM + point->y;
+    if (point->cx == chunk->x && point->cy == chunk->y) {
+        if (agent->leg != agent->next + 1 || agent->leg_version != chunk->nav.version) {
+            N_LocalCosts(chunk, point->x, point->y, agent->leg_costs);
+            agent->leg         = agent->next + 1;
+            agent->leg_version = chunk->nav.version;
+        }
+
+        u16 cost = agent->leg_costs[y * W_CHUNK_DIM + x];
+        if (cost == N_NO_PATH) {
+            agent->status = NAV_QUEUED;
+            return true;
+        }
+
+        /* downhill, some step always is */
+        for (u32 step = 0; step < 8; step++) {
+            if (!N_CanStep(chunk, x, y, step))
+                continue;
+
+            i32 nx = x + N_STEPS[step][0];
+            i32 ny = y + N_STEPS[step][1];
+            if (agent->leg_costs[ny * W_CHUNK_DIM + nx] + ((step < 4) ? N_STRAIGHT : N_DIAGONAL) == cost) {
+                to_x = nx;
+                to_y = ny;
+                break;
+            }
+        }
+    } else if (MAX(to_x - x, x - to_x) > 1 || MAX(to_y - y, y - to_y) > 1) {
+        /* knocked away from the portal it was crossing at */
+        agent->status = NAV_QUEUED;
+        return true;
+    }
+
+    /* for the middle of the tile, near enough on an axis counts as there */
+    r32 dx = (r32)to_x + 0.5f - E_TABLE(ref)->pos[ref->row].x;
+    r32 dy = (r32)to_y + 0.5f - E_TABLE(ref)->pos[ref->row].y;
+    i32 sx = (dx > 0.1f) - (dx < -0.1f);
+    i32 sy = (dy > 0.1f) - (dy < -0.1f);
+    *dir = directions[sy + 1][sx + 1];
+    return true;
+}
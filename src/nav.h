@@ -0,0 +1,125 @@
+#ifndef _NAV_h_
+#define _NAV_h_
+
+struct WorldChunk;
+struct WorldState;
+
+#include "config.h"
+#include "math.h"
+#include "entity.h"
+
+#define N_MAX_PORTALS   (24)     /* an entrance per other tile along each side */
+#define N_MAX_WAYPOINTS (64)     /* portals a path can go through */
+#define N_CHUNK_TILES   (121)    /* W_CHUNK_DIM squared, checked in nav.c */
+#define N_NO_PATH       (0xffff)
+#define N_STRAIGHT      (10)     /* cost of a step, diagonals cost N_DIAGONAL */
+#define N_DIAGONAL      (14)
+#define N_BUDGET        (2048)   /* abstract nodes expanded per tick */
+#define N_AGENTS_MIN    (16)
+
+enum NavSide {
+    NAV_NORTH,
+    NAV_SOUTH,
+    NAV_WEST,
+    NAV_EAST,
+    NavSide_COUNT
+};
+
+/* border tile with a walkable tile straight across in the next chunk */
+struct NavPortal {
+    u8 x, y;
+    u8 side;    /* enum NavSide */
+};
+
+/* a chunk's part of the abstract graph, built when a search first needs *
+ * it and thrown away when its walls or its neighbours change           */
+struct NavChunk {
+    bool valid;
+    u32  version;   /* new every time it's invalidated */
+    u32  walls;     /* version when its tiles last changed */
+    u32  count;
+    struct NavPortal portals[N_MAX_PORTALS];
+    u16  costs[N_MAX_PORTALS][N_MAX_PORTALS]; /* between portals inside the chunk */
+
+    /* the running search's nodes, only good while search matches */
+    u32                search;
+    u32                g[N_MAX_PORTALS];
+    struct WorldChunk *from_chunk[N_MAX_PORTALS]; /* NULL when reached from the start */
+    u8                 from_portal[N_MAX_PORTALS];
+};
+
+/* a tile anywhere in the world */
+struct NavPoint {
+    u32 cx, cy;
+    u8  x, y;
+};
+
+enum NavStatus {
+    NAV_QUEUED,     /* waiting for a search */
+    NAV_FOLLOWING,
+    NAV_DONE,       /* arrived or gave up, let go of on the next update */
+    NavStatus_COUNT
+};
+
+/* an npc finding its way, the waypoints are the portals it goes through *
+ * and the leg inside each chunk is only worked out once it gets there   */
+struct NavAgent {
+    struct EntityHandle handle;
+    enum NavStatus      status;
+    struct NavPoint     goal;
+
+    u32             count;
+    u32             next;
+    u32             checked;    /* NavState versions when the path was last good */
+    struct NavPoint waypoints[N_MAX_WAYPOINTS];
+
+    /* costs to the next waypoint from every tile of its chunk */
+    u32 leg;        /* waypoint the costs lead to + 1, 0 when there are none */
+    u32 leg_version;
+    u16 leg_costs[N_CHUNK_TILES];
+};
+
+struct NavNode {
+    u32                f;
+    u32                g;
+    struct WorldChunk *chunk;
+    u32                portal;
+};
+
+struct NavState {
+    struct NavAgent *agents;
+    u32 count;
+    u32 capacity;
+    u32 cursor;         /* agent to look at first for the next search */
+    u32 versions;       /* hands out NavChunk versions */
+
+    /* the search in progress, carried over ticks when out of budget */
+    u32                active;  /* agent + 1, 0 when idle */
+    u32                search;
+    bool               restart; /* something it went through changed */
+    struct WorldChunk *goal_chunk;
+    struct NavNode    *open;    /* binary heap on f */
+    u32                open_count;
+    u32                open_capacity;
+    u32                best;
+    struct WorldChunk *best_chunk;
+    u32                best_portal;
+
+    /* costs to the goal from its chunk's tiles, kept for the next search *
+     * when several npcs head for the same place                          */
+    struct NavPoint    goal;
+    u32                goal_version;
+    bool               goal_valid;
+    u16                goal_costs[N_CHUNK_TILES];
+
+    u32 expanded;       /* nodes expanded last update */
+    u32 found;          /* paths found so far */
+    u32 failed;
+};
+
+void N_InvalidateChunk(struct WorldState *world, struct WorldChunk *chunk);
+bool N_RequestPath(struct WorldState *world, struct EntityHandle handle, struct NavPoint goal);
+void N_UpdatePaths(struct WorldState *world);
+bool N_Steer(struct WorldState *world, struct EntityRef *ref, u32 *dir);
+
+#endif
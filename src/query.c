@@ -0,0 +1,314 @@
+#include "query.h"
+#include "world.h"
+
+enum QueryShape {
+    QUERY_BOX,
+    QUERY_RADIUS,
+    QUERY_SWEPT
+};
+
+/* what a query is looking for, all relative to the query's chunk */
+struct Query {
+    enum QueryShape shape;
+    struct Vec2 lo, hi;      /* bounds of everything the shape can touch */
+
+    struct Vec2 centre;      /* radius */
+    r32         radius;
+
+    struct Vec2 pos;         /* swept */
+    struct Vec2 rad;
+    struct Vec2 dpos;
+};
+
+/**
+ * Get which chunk a tile coordinate falls in, relative to its own chunk
+ */
+static inline
+i32
+Q_TileChunk(i32 v)
+{
+    return (v < 0) ? (v + 1) / W_CHUNK_DIM - 1 : v / W_CHUNK_DIM;
+}
+
+/**
+ * Find the first entry of a sweep list whose left edge isn't before a point
+ *
+ * @list   : the list
+ * @x      : the point
+ * @return : index of the entry, count if there is none
+ */
+static inline
+u32
+Q_FirstSweep(struct SweepList *list, r32 x)
+{
+    u32 lo = 0;
+    u32 hi = list->count;
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (list->entries[mid].lo < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Test an entity's box against a query's shape
+ *
+ * @query  : the query
+ * @pos    : centre of the box
+ * @rad    : half size of the box
+ * @t      : set to the time of impact for swept queries
+ * @return : true if the box is inside the shape
+ */
+static inline
+bool
+Q_Test(struct Query *query, struct Vec2 pos, struct Vec2 rad, r32 *t)
+{
+    *t = 0.0f;
+    switch (query->shape) {
+    case QUERY_BOX:
+        return pos.x - rad.x <= query->hi.x && pos.x + rad.x >= query->lo.x &&
+               pos.y - rad.y <= query->hi.y && pos.y + rad.y >= query->lo.y;
+
+    case QUERY_RADIUS: {
+        /* distance from the centre to the closest point of the box */
+        r32 dx = MAX(fabsf(pos.x - query->centre.x) - rad.x, 0.0f);
+        r32 dy = MAX(fabsf(pos.y - query->centre.y) - rad.y, 0.0f);
+        return dx * dx + dy * dy <= query->radius * query->radius;
+    }
+
+    case QUERY_SWEPT: {
+        /* slab test of the moving centre against the box grown by its radius */
+        r32 enter = -1.0f;
+        r32 exit  =  2.0f;
+        for (int i = 0; i < 2; i++) {
+            r32 lo = pos.e[i] - rad.e[i] - query->rad.e[i] - query->pos.e[i];
+            r32 hi = pos.e[i] + rad.e[i] + query->rad.e[i] - query->pos.e[i];
+            r32 d  = query->dpos.e[i];
+            if (fabsf(d) < 0.000001f) {
+                if (lo > 0.0f || hi < 0.0f)
+                    return false;
+                continue;
+            }
+
+            r32 t0 = lo / d;
+            r32 t1 = hi / d;
+            enter = MAX(enter, MIN(t0, t1));
+            exit  = MIN(exit, MAX(t0, t1));
+        }
+        if (enter > exit || exit < 0.0f || enter > 1.0f)
+            return false;
+
+        *t = MAX(enter, 0.0f);
+        return true;
+    }
+    }
+
+    return false;
+}
+
+/**
+ * Collect the entities a query's shape touches
+ *
+ * @world      : the current world
+ * @chunk      : chunk the query is relative to
+ * @query      : the query
+ * @components : COMP_BITs an entity needs to be considered
+ * @stack      : where the hits go
+ * @out        : filled in with the hits
+ *
+ * Only chunks within the query bounds, grown by Q_MARGIN, are visited, and
+ * only the part of each chunk's sweep list overlapping the bounds along x.
+ * Hits come out by chunk, then by the left edge of their box.
+ */
+static
+void
+Q_Gather(struct WorldState *world, struct WorldChunk *chunk, struct Query *query, u32 components,
+         struct Stack *stack, struct QueryHits *out)
+{
+    out->hits  = NULL;
+    out->count = 0;
+    components |= COMP_BIT(COMP_POS) | COMP_BIT(COMP_RAD);
+
+    i32 cx0 = (i32)floorf((query->lo.x - Q_MARGIN) / W_CHUNK_DIM);
+    i32 cx1 = (i32)floorf((query->hi.x + Q_MARGIN) / W_CHUNK_DIM);
+    i32 cy0 = (i32)floorf((query->lo.y - Q_MARGIN) / W_CHUNK_DIM);
+    i32 cy1 = (i32)floorf((query->hi.y + Q_MARGIN) / W_CHUNK_DIM);
+    for (i32 cy = cy0; cy <= cy1; cy++) {
+        for (i32 cx = cx0; cx <= cx1; cx++) {
+            struct WorldChunk *other = chunk;
+            if (cx != 0 || cy != 0)
+                other = W_GetChunk(world, chunk->x + cx, chunk->y + cy, false);
+            if (other == NULL)
+                continue;
+
+            struct Vec2 offset = { (r32)(cx * W_CHUNK_DIM), (r32)(cy * W_CHUNK_DIM) };
+            struct SweepList *list = &other->sweep;
+            r32 lo = query->lo.x - offset.x - Q_SWEEP_SLOP;
+            r32 hi = query->hi.x - offset.x + Q_SWEEP_SLOP;
+
+            /* nothing starting further left than the widest box can reach lo */
+            u32 first = Q_FirstSweep(list, lo - list->max_width - Q_SWEEP_SLOP);
+            for (u32 i = first; i < list->count && list->entries[i].lo <= hi; i++) {
+                struct SweepEntry *entry = &list->entries[i];
+                if (entry->hi < lo)
+                    continue;
+
+                struct EntitySlot *slot = &world->slots[entry->id];
+                struct EntityTable *table = &other->tables[slot->arch];
+                if ((ARCHETYPES[slot->arch] & components) != components)
+                    continue;
+
+                struct Vec2 pos = V2_Add(table->pos[slot->row], offset);
+                r32 t;
+                if (!Q_Test(query, pos, table->rad[slot->row], &t))
+                    continue;
+
+                struct QueryHit *hit = Z_PushStructAligned(stack, struct QueryHit,
+                                                           _Alignof(struct QueryHit), MEM_WORLD, false);
+                if (out->count++ == 0)
+                    out->hits = hit;
+                ASSERT(hit == out->hits + out->count - 1);
+
+                hit->ref = (struct EntityRef){ other, slot->arch, slot->row };
+                hit->pos = pos;
+                hit->rad = table->rad[slot->row];
+                hit->t   = t;
+            }
+        }
+    }
+}
+
+/**
+ * Find the entities whose boxes overlap a box
+ *
+ * @world      : the current world
+ * @chunk      : chunk the coordinates are relative to
+ * @lo         : min corner
+ * @hi         : max corner
+ * @components : COMP_BITs an entity needs to be considered
+ * @stack      : where the hits go, nothing else may push to it meanwhile
+ * @out        : filled in with the hits
+ */
+void
+Q_Box(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 lo, struct Vec2 hi,
+      u32 components, struct Stack *stack, struct QueryHits *out)
+{
+    struct Query query = { .shape = QUERY_BOX, .lo = lo, .hi = hi };
+    Q_Gather(world, chunk, &query, components, stack, out);
+}
+
+/**
+ * Find the entities whose boxes are within a distance of a point
+ *
+ * @world      : the current world
+ * @chunk      : chunk the coordinates are relative to
+ * @centre     : the point
+ * @radius     : the distance
+ * @components : COMP_BITs an entity needs to be considered
+ * @stack      : where the hits go, nothing else may push to it meanwhile
+ * @out        : filled in with the hits
+ */
+void
+Q_Radius(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 centre, r32 radius,
+         u32 components, struct Stack *stack, struct QueryHits *out)
+{
+    struct Query query = {
+        .shape  = QUERY_RADIUS,
+        .lo     = { centre.x - radius, centre.y - radius },
+        .hi     = { centre.x + radius, centre.y + radius },
+        .centre = centre,
+        .radius = radius,
+    };
+    Q_Gather(world, chunk, &query, components, stack, out);
+}
+
+/**
+ * Find the entities a moving box could hit
+ *
+ * @world      : the current world
+ * @chunk      : chunk the coordinates are relative to
+ * @pos        : where the box starts
+ * @rad        : half size of the box
+ * @dpos       : how far it moves
+ * @components : COMP_BITs an entity needs to be considered
+ * @stack      : where the hits go, nothing else may push to it meanwhile
+ * @out        : filled in with the hits, t is when each is first touched
+ *
+ * Boxes already touching at the start are included with t of 0.
+ */
+void
+Q_Swept(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 pos, struct Vec2 rad,
+        struct Vec2 dpos, u32 components, struct Stack *stack, struct QueryHits *out)
+{
+    struct Vec2 end = V2_Add(pos, dpos);
+    struct Query query = {
+        .shape = QUERY_SWEPT,
+        .lo    = { MIN(pos.x, end.x) - rad.x, MIN(pos.y, end.y) - rad.y },
+        .hi    = { MAX(pos.x, end.x) + rad.x, MAX(pos.y, end.y) + rad.y },
+        .pos   = pos,
+        .rad   = rad,
+        .dpos  = dpos,
+    };
+    Q_Gather(world, chunk, &query, components, stack, out);
+}
+
+/**
+ * Find the tiles that aren't floor within a box
+ *
+ * @world : the current world
+ * @chunk : chunk the coordinates are relative to
+ * @lo    : min corner
+ * @hi    : max corner
+ * @stack : where the tiles go, nothing else may push to it meanwhile
+ * @out   : filled in with the tiles, row by row
+ *
+ * Each run of a row inside one chunk only looks the chunk up once.
+ * Tiles in chunks that aren't loaded are taken as floor.
+ */
+void
+Q_Tiles(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 lo, struct Vec2 hi,
+        struct Stack *stack, struct QueryTiles *out)
+{
+    out->tiles = NULL;
+    out->count = 0;
+
+    i32 x0 = (i32)floorf(lo.x);
+    i32 x1 = (i32)floorf(hi.x);
+    i32 y0 = (i32)floorf(lo.y);
+    i32 y1 = (i32)floorf(hi.y);
+    for (i32 y = y0; y <= y1; y++) {
+        i32 cy = Q_TileChunk(y);
+        i32 ty = y - cy * W_CHUNK_DIM;
+        for (i32 x = x0; x <= x1;) {
+            i32 cx  = Q_TileChunk(x);
+            i32 end = MIN(x1, (cx + 1) * W_CHUNK_DIM - 1);
+
+            struct WorldChunk *other = chunk;
+            if (cx != 0 || cy != 0)
+                other = W_GetChunk(world, chunk->x + cx, chunk->y + cy, false);
+
+            if (other != NULL) {
+                u8 *row = &other->tiles[ty * W_CHUNK_DIM];
+                for (i32 tx = x; tx <= end; tx++) {
+                    u8 id = row[tx - cx * W_CHUNK_DIM];
+                    if (id == W_TILE_FLOOR)
+                        continue;
+
+                    struct QueryTile *tile = Z_PushStructAligned(stack, struct QueryTile,
+                                                                 _Alignof(struct QueryTile), MEM_WORLD, false);
+                    if (out->count++ == 0)
+                        out->tiles = tile;
+                    ASSERT(tile == out->tiles + out->count - 1);
+
+                    tile->x    = tx;
+                    tile->y    = y;
+                    tile->tile = id;
+                }
+            }
+            x = end + 1;
+        }
+    }
+}
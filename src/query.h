@@ -0,0 +1,52 @@
+#ifndef _QUERY_h_
+#define _QUERY_h_
+
+#include "config.h"
+#include "math.h"
+#include "memory.h"
+#include "entity.h"
+
+struct WorldState;
+struct WorldChunk;
+
+/* how far an entity's box may reach past its chunk */
+#define Q_MARGIN (1.0f)
+
+/* covers rounding in the sweep list, Q_Test has the final say */
+#define Q_SWEEP_SLOP (0.001f)
+
+/* an entity found by a query, positions are relative to the query's chunk */
+struct QueryHit {
+    struct EntityRef ref;
+    struct Vec2      pos;
+    struct Vec2      rad;
+    r32              t;   /* when a swept box first touches it, 0 otherwise */
+};
+
+/* a tile that isn't floor, found by a tile query */
+struct QueryTile {
+    i32 x, y;             /* relative to the query's chunk */
+    u8  tile;             /* enum TileId */
+};
+
+/* results sit back to back on the stack given to the query */
+struct QueryHits {
+    struct QueryHit *hits;
+    u32 count;
+};
+
+struct QueryTiles {
+    struct QueryTile *tiles;
+    u32 count;
+};
+
+void Q_Box(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 lo, struct Vec2 hi,
+           u32 components, struct Stack *stack, struct QueryHits *out);
+void Q_Radius(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 centre, r32 radius,
+              u32 components, struct Stack *stack, struct QueryHits *out);
+void Q_Swept(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 pos, struct Vec2 rad,
+             struct Vec2 dpos, u32 components, struct Stack *stack, struct QueryHits *out);
+void Q_Tiles(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 lo, struct Vec2 hi,
+             struct Stack *stack, struct QueryTiles *out);
+
+#endif
@@ -6,10 +6,9 @@
 
 /* MAKE AUTOGEN - DO NOT CHANGE ANYTHING UNDER THIS LINE */
 
-/* all sprite sheets */
+/* atlas pages every sheet was packed into */
 enum SpriteSheetId {
-    TILE_WALL,
-    CHARACTER,
+    ATLAS0,
     SpriteSheet_COUNT
 };
 
@@ -40,4 +39,7 @@ struct Animation {
 /* animations list */
 extern struct Animation SPRITES[Anim_COUNT];
 
+/* image of each atlas page, relative to the binary */
+extern const char *SHEET_FILES[SpriteSheet_COUNT];
+
 #endif
\ No newline at end of file
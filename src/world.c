@@ -1,8 +1,226 @@
 struct WorldState;
 struct WorldChunk;
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "game.h"
 #include "world.h"
+#include "job.h"
+
+struct TileInfo W_TILES[Tile_COUNT] = {
+    [W_TILE_FLOOR] = { .solid = false, .drawn = false },
+    [W_TILE_WALL]  = { .solid = true,  .drawn = true, .animation = TILE_WALL_STAND0,
+                       .render_off = { -0.5f, -1.5f } },
+};
+
+/**
+ * Hash chunk coordinates
+ *
+ * @x : x coordinate
+ * @y : y coordinate
+ *
+ * Both coordinates go through a 64 bit finalizer so neighbouring and
+ * diagonal chunks spread over the whole table.
+ */
+static inline
+u32
+W_HashChunk(u32 x, u32 y)
+{
+    u64 h = ((u64)x << 32) | (u64)y;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return (u32)h;
+}
+
+/**
+ * Get how far a slot's entry sits from where it hashed to
+ *
+ * @table : the chunk table
+ * @index : index of an occupied slot
+ */
+static inline
+u32
+W_ProbeLength(struct ChunkTable *table, u32 index)
+{
+    struct ChunkSlot *slot = &table->slots[index];
+    return (index - W_HashChunk(slot->x, slot->y)) & (table->capacity - 1);
+}
+
+/**
+ * Put a chunk into the table, which must have room and not hold it yet
+ *
+ * @table : the chunk table
+ * @entry : chunk to insert and its coordinates
+ *
+ * Robin hood insertion: whenever the entry being placed is further from
+ * home than the one in the slot, they swap, keeping probe lengths even.
+ */
+void
+W_TableInsert(struct ChunkTable *table, struct ChunkSlot entry)
+{
+    u32 mask = table->capacity - 1;
+    u32 index = W_HashChunk(entry.x, entry.y) & mask;
+    u32 dist  = 0;
+
+    while (table->slots[index].chunk != NULL) {
+        u32 other = W_ProbeLength(table, index);
+        if (other < dist) {
+            struct ChunkSlot swap = table->slots[index];
+            table->slots[index] = entry;
+            entry = swap;
+            dist  = other;
+        }
+        index = (index + 1) & mask;
+        dist++;
+    }
+
+    table->slots[index] = entry;
+    table->count++;
+}
+
+/**
+ * Find the slot holding a chunk
+ *
+ * @table  : the chunk table
+ * @x      : x coordinate
+ * @y      : y coordinate
+ * @return : slot index, or capacity when not found
+ *
+ * Stops early once the probe gets further from home than the entry it's
+ * looking at, since robin hood insertion would have placed it before.
+ */
+u32
+W_TableFind(struct ChunkTable *table, u32 x, u32 y)
+{
+    u32 mask  = table->capacity - 1;
+    u32 index = W_HashChunk(x, y) & mask;
+
+    for (u32 dist = 0; table->slots[index].chunk != NULL; dist++) {
+        struct ChunkSlot *slot = &table->slots[index];
+        if (slot->x == x && slot->y == y)
+            return index;
+        if (W_ProbeLength(table, index) < dist)
+            break;
+        index = (index + 1) & mask;
+    }
+
+    return table->capacity;
+}
+
+/**
+ * Remove the entry in a slot
+ *
+ * @table : the chunk table
+ * @index : occupied slot to clear
+ *
+ * Entries after it shift back one slot until one is already home, so no
+ * tombstones are ever left behind.
+ */
+void
+W_TableErase(struct ChunkTable *table, u32 index)
+{
+    u32 mask = table->capacity - 1;
+    u32 next = (index + 1) & mask;
+    while (table->slots[next].chunk != NULL && W_ProbeLength(table, next) > 0) {
+        table->slots[index] = table->slots[next];
+        index = next;
+        next  = (next + 1) & mask;
+    }
+
+    table->slots[index].chunk = NULL;
+    table->count--;
+}
+
+/**
+ * Make the table big enough for one more chunk
+ *
+ * @world : world owning the table
+ *
+ * Doubles once past 3/4 full. The old slots are left on the world stack,
+ * which at most doubles the table's footprint since sizes are geometric.
+ */
+void
+W_TableReserve(struct WorldState *world)
+{
+    struct ChunkTable *table = &world->table;
+    if (table->slots != NULL && (table->count + 1) * 4 <= table->capacity * 3)
+        return;
+
+    struct ChunkTable old = *table;
+    table->capacity = old.slots ? old.capacity * 2 : W_TABLE_MIN;
+    table->count    = 0;
+    table->slots    = Z_PushArrayAligned(world->stack, struct ChunkSlot, table->capacity,
+                                         Z_CACHELINE, MEM_WORLD, true);
+
+    for (u32 i = 0; i < old.capacity; i++) {
+        if (old.slots[i].chunk != NULL)
+            W_TableInsert(table, old.slots[i]);
+    }
+}
+
+/**
+ * Initialize the world's allocators
+ *
+ * @world : world to initialize, expected to be zeroed
+ * @stack : where the world allocates from
+ */
+void
+W_InitWorld(struct WorldState *world, struct Stack *stack)
+{
+    world->stack = stack;
+    Z_InitPool(&world->chunk_pool, stack, sizeof(struct WorldChunk), W_CHUNK_SLAB, MEM_WORLD);
+    for (int i = 0; i < W_COLUMN_CLASSES; i++) {
+        size_t size = (size_t)W_COLUMN_MIN << i;
+        Z_InitPool(&world->column_pools[i], stack, size, MAX(1, W_COLUMN_SLAB / size), MEM_ENTITY);
+    }
+    W_TableReserve(world);
+}
+
+/**
+ * Get the size class a column of some size comes from
+ */
+static inline
+u32
+W_ColumnClass(size_t size)
+{
+    u32 result = 0;
+    while (((size_t)W_COLUMN_MIN << result) < size)
+        result++;
+    ASSERT(result < W_COLUMN_CLASSES);
+    return result;
+}
+
+/**
+ * Allocate a block for an entity table column
+ *
+ * @world  : the current world
+ * @size   : bytes needed
+ * @return : block of at least @size bytes, 16 byte aligned
+ */
+void *
+W_AllocColumn(struct WorldState *world, size_t size)
+{
+    return Z_PoolAlloc_(&world->column_pools[W_ColumnClass(size)], false);
+}
+
+/**
+ * Release a column block
+ *
+ * @world  : the current world
+ * @column : block from W_AllocColumn
+ * @size   : the size it was allocated with
+ */
+void
+W_FreeColumn(struct WorldState *world, void *column, size_t size)
+{
+    Z_PoolFree(&world->column_pools[W_ColumnClass(size)], column);
+}
 
 /**
  * Get a world chunk from the world, and create one if not found and the 
@@ -13,10 +231,8 @@ struct WorldChunk;
  * @y      : y coordinate
  * @create : whether or not to create one
  *
- * Create flag should only be set to true when generating the map in the
- * first place.
- *
- * TODO(david): perhaps only use create in a lazy generation?
+ * Created chunks are empty, use W_LoadChunk to get one with its content
+ * generated.
  */
 struct WorldChunk *
 W_GetChunk(struct WorldState *world, u32 x, u32 y, bool create)
@@ -24,83 +240,1142 @@ W_GetChunk(struct WorldState *world, u32 x, u32 y, bool create)
     if (x < 1 || y < 1 || x == ~0 || y == ~0) 
         return NULL;
 
-    u32 hash = (x + y * 31) % WORLD_HASHSIZE;
-    struct WorldChunk *result = &world->chunks[hash];
-    while (result != NULL) {
-        if (result->next == NULL && (result->x != x || result->y != y) && create) {
-            /* TODO(david): need proper alloc */
-            result->next = Z_PushStruct(world->stack, struct WorldChunk, true);
-            result = result->next;
-            result->x = x;
-            result->y = y;
-        } 
-        if (result->x == x && result->y == y) {
-            return result;
+    struct ChunkTable *table = &world->table;
+    u32 index = W_TableFind(table, x, y);
+    if (index != table->capacity)
+        return table->slots[index].chunk;
+    if (!create)
+        return NULL;
+
+    W_TableReserve(world);
+    struct WorldChunk *result = Z_PoolAllocStruct(&world->chunk_pool, struct WorldChunk, true);
+    result->x = x;
+    result->y = y;
+    W_TableInsert(table, (struct ChunkSlot){ x, y, result });
+    result->version = ++world->versions;
+    N_InvalidateChunk(world, result);
+
+    return result;
+}
+
+/**
+ * Remove a chunk from the world, releasing it and every entity in it
+ *
+ * @world : the current world
+ * @x     : x coordinate
+ * @y     : y coordinate
+ */
+void
+W_RemoveChunk(struct WorldState *world, u32 x, u32 y)
+{
+    if (x < 1 || y < 1 || x == ~0 || y == ~0)
+        return;
+
+    struct ChunkTable *table = &world->table;
+    u32 index = W_TableFind(table, x, y);
+    if (index == table->capacity)
+        return;
+
+    struct WorldChunk *chunk = table->slots[index].chunk;
+    N_InvalidateChunk(world, chunk);
+    E_FreeTables(world, chunk);
+
+    W_TableErase(table, index);
+    Z_PoolFree(&world->chunk_pool, chunk);
+}
+
+/**
+ * Gather probe length statistics for the chunk table
+ *
+ * @world : the current world
+ * @stats : filled in with the results
+ */
+void
+W_ChunkTableStats(struct WorldState *world, struct ChunkTableStats *stats)
+{
+    struct ChunkTable *table = &world->table;
+    u64 total = 0;
+
+    stats->count     = table->count;
+    stats->capacity  = table->capacity;
+    stats->max_probe = 0;
+    for (u32 i = 0; i < table->capacity; i++) {
+        if (table->slots[i].chunk == NULL)
+            continue;
+
+        u32 probe = W_ProbeLength(table, i);
+        total += probe;
+        stats->max_probe = MAX(stats->max_probe, probe);
+    }
+    stats->mean_probe = table->count ? (r32)total / (r32)table->count : 0.0f;
+}
+
+/**
+ * Get a tile by coordinates relative to a chunk
+ *
+ * @world  : the current world
+ * @chunk  : chunk the coordinates are relative to
+ * @x      : tile column, may be outside the chunk
+ * @y      : tile row, may be outside the chunk
+ * @return : the tile, floor when its chunk isn't loaded
+ */
+u8
+W_GetTile(struct WorldState *world, struct WorldChunk *chunk, i32 x, i32 y)
+{
+    i32 cx = (x < 0) ? (x + 1) / W_CHUNK_DIM - 1 : x / W_CHUNK_DIM;
+    i32 cy = (y < 0) ? (y + 1) / W_CHUNK_DIM - 1 : y / W_CHUNK_DIM;
+    if (cx != 0 || cy != 0) {
+        chunk = W_GetChunk(world, chunk->x + cx, chunk->y + cy, false);
+        if (chunk == NULL)
+            return W_TILE_FLOOR;
+        x -= cx * W_CHUNK_DIM;
+        y -= cy * W_CHUNK_DIM;
+    }
+    return chunk->tiles[y * W_CHUNK_DIM + x];
+}
+
+/**
+ * Change a tile by coordinates relative to a chunk
+ *
+ * @world : the current world
+ * @chunk : chunk the coordinates are relative to
+ * @x     : tile column, may be outside the chunk
+ * @y     : tile row, may be outside the chunk
+ * @tile  : enum TileId to put there, nothing happens if its chunk isn't loaded
+ *
+ * Only the pathfinding of the chunk and its neighbours is thrown away.
+ */
+void
+W_SetTile(struct WorldState *world, struct WorldChunk *chunk, i32 x, i32 y, u8 tile)
+{
+    i32 cx = (x < 0) ? (x + 1) / W_CHUNK_DIM - 1 : x / W_CHUNK_DIM;
+    i32 cy = (y < 0) ? (y + 1) / W_CHUNK_DIM - 1 : y / W_CHUNK_DIM;
+    if (cx != 0 || cy != 0) {
+        chunk = W_GetChunk(world, chunk->x + cx, chunk->y + cy, false);
+        if (chunk == NULL)
+            return;
+        x -= cx * W_CHUNK_DIM;
+        y -= cy * W_CHUNK_DIM;
+    }
+    if (chunk->tiles[y * W_CHUNK_DIM + x] == tile)
+        return;
+
+    chunk->tiles[y * W_CHUNK_DIM + x] = tile;
+    chunk->dirty = true;
+    chunk->version = ++world->versions;
+    N_InvalidateChunk(world, chunk);
+}
+
+/**
+ * Get the size of a chunk slot in the world file, rounded to whole pages
+ * so writing one back never touches its neighbours
+ */
+static inline
+size_t
+W_FileSlotSize(void)
+{
+    return (sizeof(struct WorldFileChunk) + W_FILE_PAGE - 1) & ~(size_t)(W_FILE_PAGE - 1);
+}
+
+/**
+ * Get how long the world file is with some number of slots
+ */
+static inline
+size_t
+W_FileLength(u32 slot_capacity)
+{
+    return W_FILE_PAGE + W_FileSlotSize() * slot_capacity;
+}
+
+/**
+ * Get how many slots an index of some capacity takes up
+ */
+static inline
+u32
+W_FileIndexSlots(u32 index_capacity)
+{
+    return (sizeof(struct WorldFileIndex) * index_capacity + W_FileSlotSize() - 1) / W_FileSlotSize();
+}
+
+/**
+ * Get a slot in the world file by number + 1
+ */
+static inline
+struct WorldFileChunk *
+W_FileSlot(struct WorldFile *file, u32 slot)
+{
+    return (struct WorldFileChunk *)(file->slots + (size_t)(slot - 1) * W_FileSlotSize());
+}
+
+/**
+ * Note part of the mapped world file was written, for the next flush
+ *
+ * @file  : mapped world file
+ * @start : first byte written, the header or somewhere in the slots
+ * @size  : how many bytes
+ */
+static
+void
+W_FileDirty(struct WorldFile *file, void *start, size_t size)
+{
+    SDL_AtomicLock(&file->dirty_lock);
+    if ((u8 *)start < file->slots) {
+        file->dirty_header = true;
+    } else {
+        size_t lo = (u8 *)start - file->slots;
+        file->dirty_lo = MIN(file->dirty_lo, lo);
+        file->dirty_hi = MAX(file->dirty_hi, lo + size);
+    }
+    SDL_AtomicUnlock(&file->dirty_lock);
+}
+
+/**
+ * Flush the part of the world file written since the last flush
+ *
+ * @file : mapped world file
+ *
+ * Slots go to disk before the header that points at them.
+ */
+static
+void
+W_FileFlush(struct WorldFile *file)
+{
+    SDL_AtomicLock(&file->dirty_lock);
+    bool   header = file->dirty_header;
+    size_t lo     = file->dirty_lo;
+    size_t hi     = file->dirty_hi;
+    file->dirty_header = false;
+    file->dirty_lo     = SIZE_MAX;
+    file->dirty_hi     = 0;
+    SDL_AtomicUnlock(&file->dirty_lock);
+
+    if (lo < hi) {
+        lo &= ~(size_t)(W_FILE_PAGE - 1);
+        msync(file->slots + lo, hi - lo, MS_SYNC);
+    }
+    if (header)
+        msync(file->base, W_FILE_PAGE, MS_SYNC);
+}
+
+/**
+ * Map a world file, creating it when it doesn't exist yet
+ *
+ * @world  : the current world
+ * @path   : file to use
+ * @return : true if the world is now backed by the file
+ *
+ * The file starts with room for W_FILE_SLOTS slots but left sparse, so
+ * only chunks that were actually written take up disk space. The mapping
+ * covers W_FILE_RESERVE, so growing the file later never moves it. Chunks
+ * missing from the file are generated and written back when they're
+ * evicted.
+ */
+bool
+W_OpenWorldFile(struct WorldState *world, const char *path)
+{
+    struct WorldFile *file = &world->file;
+    size_t size = W_FILE_RESERVE;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Can't open world file %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    bool fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    if (fresh && ftruncate(fd, W_FileLength(W_FILE_SLOTS)) == -1) {
+        fprintf(stderr, "Can't size world file %s\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Can't map world file %s\n", path);
+        close(fd);
+        return false;
+    }
+
+    struct WorldFileHeader *header = (struct WorldFileHeader *)base;
+    if (fresh) {
+        /* the index takes the first slots */
+        header->magic          = W_FILE_MAGIC;
+        header->chunk_dim      = W_CHUNK_DIM;
+        header->slot_size      = W_FileSlotSize();
+        header->slot_capacity  = W_FILE_SLOTS;
+        header->slot_count     = W_FileIndexSlots(W_FILE_INDEX);
+        header->free_slot      = 0;
+        header->free_count     = 0;
+        header->index_slot     = 1;
+        header->index_capacity = W_FILE_INDEX;
+        header->chunk_count    = 0;
+    } else if (header->magic != W_FILE_MAGIC || header->chunk_dim != W_CHUNK_DIM ||
+               header->slot_size != W_FileSlotSize() || W_FileLength(header->slot_capacity) > size ||
+               st.st_size != (off_t)W_FileLength(header->slot_capacity)) {
+        fprintf(stderr, "World file %s doesn't match this build\n", path);
+        munmap(base, size);
+        close(fd);
+        return false;
+    }
+
+    /* chunks are looked up all over the file, readahead would be wasted */
+    madvise(base, size, MADV_RANDOM);
+
+    file->fd     = fd;
+    file->base   = base;
+    file->size   = size;
+    file->header = header;
+    file->slots  = base + W_FILE_PAGE;
+    file->index  = (struct WorldFileIndex *)W_FileSlot(file, header->index_slot);
+    file->full   = false;
+    file->dirty_header = fresh;
+    file->dirty_lo     = SIZE_MAX;
+    file->dirty_hi     = 0;
+    return true;
+}
+
+/**
+ * Say the world file can't grow, the first time it happens
+ */
+static
+void
+W_FileFull(struct WorldFile *file)
+{
+    if (!file->full)
+        fprintf(stderr, "World file can't grow, chunks that can't be saved stay loaded\n");
+    file->full = true;
+}
+
+/**
+ * Double the world file until it has room for some number of slots
+ *
+ * @file   : mapped world file
+ * @wanted : slots the file should hold
+ * @return : false if the file couldn't grow enough
+ *
+ * The mapping already covers the new length, so nothing moves.
+ */
+static
+bool
+W_FileGrow(struct WorldFile *file, u64 wanted)
+{
+    struct WorldFileHeader *header = file->header;
+    if (wanted <= header->slot_capacity)
+        return true;
+
+    u64 capacity = header->slot_capacity;
+    while (capacity < wanted)
+        capacity *= 2;
+    if (capacity > UINT32_MAX || W_FileLength((u32)capacity) > file->size ||
+        ftruncate(file->fd, W_FileLength((u32)capacity)) == -1) {
+        W_FileFull(file);
+        return false;
+    }
+
+    header->slot_capacity = (u32)capacity;
+    W_FileDirty(file, header, sizeof(*header));
+    return true;
+}
+
+/**
+ * Make sure some more slots can be handed out
+ *
+ * @file   : mapped world file
+ * @count  : slots about to be taken
+ * @return : false if the file couldn't grow enough
+ *
+ * Freed slots are used first, the file only grows past those.
+ */
+static
+bool
+W_FileReserve(struct WorldFile *file, u32 count)
+{
+    struct WorldFileHeader *header = file->header;
+    if (count <= header->free_count)
+        return true;
+
+    return W_FileGrow(file, (u64)header->slot_count + count - header->free_count);
+}
+
+/**
+ * Hand out a slot, reserved beforehand with W_FileReserve
+ *
+ * @file   : mapped world file
+ * @return : slot number + 1, emptied
+ */
+static
+u32
+W_FileTakeSlot(struct WorldFile *file)
+{
+    struct WorldFileHeader *header = file->header;
+    u32 slot;
+    if (header->free_slot != 0) {
+        slot = header->free_slot;
+        header->free_slot = W_FileSlot(file, slot)->next;
+        header->free_count--;
+    } else {
+        ASSERT(header->slot_count < header->slot_capacity);
+        slot = ++header->slot_count;
+    }
+
+    W_FileSlot(file, slot)->count = 0;
+    W_FileSlot(file, slot)->next  = 0;
+    W_FileDirty(file, header, sizeof(*header));
+    W_FileDirty(file, W_FileSlot(file, slot), W_FileSlotSize());
+    return slot;
+}
+
+/**
+ * Put a chain of slots on the free list
+ *
+ * @file : mapped world file
+ * @slot : first slot number + 1 of the chain
+ */
+static
+void
+W_FileFreeChain(struct WorldFile *file, u32 slot)
+{
+    struct WorldFileHeader *header = file->header;
+    while (slot != 0) {
+        struct WorldFileChunk *link = W_FileSlot(file, slot);
+        u32 next = link->next;
+        link->count = 0;
+        link->next  = header->free_slot;
+        header->free_slot = slot;
+        header->free_count++;
+        W_FileDirty(file, header, sizeof(*header));
+        W_FileDirty(file, link, W_FileSlotSize());
+        slot = next;
+    }
+}
+
+/**
+ * Get where a chunk is or would go in the index
+ */
+static
+struct WorldFileIndex *
+W_FileProbe(struct WorldFile *file, u32 x, u32 y)
+{
+    /* the index is never more than half full, so probing ends */
+    u32 mask  = file->header->index_capacity - 1;
+    u32 index = W_HashChunk(x, y) & mask;
+    while (file->index[index].slot != 0) {
+        struct WorldFileIndex *entry = &file->index[index];
+        if (entry->x == x && entry->y == y)
+            break;
+        index = (index + 1) & mask;
+    }
+    return &file->index[index];
+}
+
+/**
+ * Double the index into a fresh run of slots at the end of the file
+ *
+ * @file   : mapped world file
+ * @return : false if the file couldn't grow
+ *
+ * The slots of the old index go on the free list for chunks to use.
+ */
+static
+bool
+W_FileGrowIndex(struct WorldFile *file)
+{
+    struct WorldFileHeader *header = file->header;
+    u32 capacity = header->index_capacity * 2;
+    u32 count    = W_FileIndexSlots(capacity);
+
+    /* a run has to come off the end, freed slots are scattered */
+    if (!W_FileGrow(file, (u64)header->slot_count + count))
+        return false;
+
+    u32 first = header->slot_count + 1;
+    header->slot_count += count;
+    struct WorldFileIndex *old = file->index;
+    u32 old_capacity = header->index_capacity;
+    u32 old_first    = header->index_slot;
+
+    file->index = (struct WorldFileIndex *)W_FileSlot(file, first);
+    Z_ZeroSize(file->index, sizeof(struct WorldFileIndex) * capacity);
+    header->index_slot     = first;
+    header->index_capacity = capacity;
+    W_FileDirty(file, header, sizeof(*header));
+    W_FileDirty(file, file->index, sizeof(struct WorldFileIndex) * capacity);
+    for (u32 i = 0; i < old_capacity; i++) {
+        if (old[i].slot != 0)
+            *W_FileProbe(file, old[i].x, old[i].y) = old[i];
+    }
+
+    for (u32 i = 0; i < W_FileIndexSlots(old_capacity); i++) {
+        W_FileSlot(file, old_first + i)->next = 0;
+        W_FileFreeChain(file, old_first + i);
+    }
+    return true;
+}
+
+/**
+ * Find a chunk's slot in the world file
+ *
+ * @file   : mapped world file
+ * @x      : x coordinate
+ * @y      : y coordinate
+ * @create : hand out a new slot if the chunk doesn't have one
+ * @return : the slot, NULL if missing or the file couldn't grow
+ */
+static
+struct WorldFileChunk *
+W_FileFind(struct WorldFile *file, u32 x, u32 y, bool create)
+{
+    struct WorldFileIndex *entry = W_FileProbe(file, x, y);
+    if (entry->slot != 0)
+        return W_FileSlot(file, entry->slot);
+    if (!create)
+        return NULL;
+
+    struct WorldFileHeader *header = file->header;
+    if (header->chunk_count + 1 > header->index_capacity / 2) {
+        if (!W_FileGrowIndex(file))
+            return NULL;
+        entry = W_FileProbe(file, x, y);
+    }
+    if (!W_FileReserve(file, 1))
+        return NULL;
+
+    *entry = (struct WorldFileIndex){ x, y, W_FileTakeSlot(file) };
+    header->chunk_count++;
+    W_FileDirty(file, entry, sizeof(*entry));
+    W_FileDirty(file, header, sizeof(*header));
+    return W_FileSlot(file, entry->slot);
+}
+
+/**
+ * Write a chunk back to the world file if it changed
+ *
+ * @world  : the current world
+ * @chunk  : chunk to write
+ * @return : false if it didn't fit or there's no file, it has to stay loaded
+ *
+ * Entities past the first slot spill into a chain of slots. The chain is
+ * kept for the next save, and whatever a smaller chunk doesn't need goes
+ * back on the free list. Only the mapping is written, the writer thread
+ * gets it to disk.
+ */
+static
+bool
+W_SaveChunk(struct WorldState *world, struct WorldChunk *chunk)
+{
+    struct WorldFile *file = &world->file;
+    if (!chunk->dirty)
+        return true;
+    if (file->base == NULL)
+        return false;
+
+    struct WorldFileChunk *slot = W_FileFind(file, chunk->x, chunk->y, true);
+    if (slot == NULL)
+        return false;
+
+    /* make sure the chain can grow long enough before touching any of it */
+    u32 total = 0;
+    for (int arch = 0; arch < Arch_COUNT; arch++) {
+        if (arch != ARCH_PLAYER)
+            total += chunk->tables[arch].count;
+    }
+    u32 chain = 1;
+    for (struct WorldFileChunk *link = slot; link->next != 0; link = W_FileSlot(file, link->next))
+        chain++;
+    u32 needed = MAX((total + W_FILE_ENTITIES - 1) / W_FILE_ENTITIES, 1);
+    if (needed > chain && !W_FileReserve(file, needed - chain))
+        return false;
+
+    slot->x = chunk->x;
+    slot->y = chunk->y;
+    Z_CopySize(slot->tiles, chunk->tiles, sizeof(chunk->tiles));
+    W_FileDirty(file, slot, W_FileSlotSize());
+
+    struct WorldFileChunk *out = slot;
+    out->count = 0;
+    for (int arch = 0; arch < Arch_COUNT; arch++) {
+        struct EntityTable *table = &chunk->tables[arch];
+        if (arch == ARCH_PLAYER)
+            continue;
+
+        for (u32 row = 0; row < table->count; row++) {
+            if (out->count == W_FILE_ENTITIES) {
+                if (out->next == 0)
+                    out->next = W_FileTakeSlot(file);
+                out = W_FileSlot(file, out->next);
+                out->x     = chunk->x;
+                out->y     = chunk->y;
+                out->count = 0;
+                W_FileDirty(file, out, W_FileSlotSize());
+            }
+
+            struct EntityRow in;
+            E_GetRow(table, row, &in);
+            out->entities[out->count++] = (struct WorldFileEntity){
+                .arch       = arch,
+                .pos        = in.pos,
+                .vel        = in.vel,
+                .rad        = in.rad,
+                .animation  = in.animation,
+                .render_off = in.render_off,
+                .render_dt  = in.render_dt,
+                .wander     = in.wander,
+            };
+        }
+    }
+
+    /* whatever's left of a longer chain is freed */
+    W_FileFreeChain(file, out->next);
+    out->next = 0;
+
+    chunk->dirty = false;
+    return true;
+}
+
+/**
+ * Fill a freshly created chunk from the world file
+ *
+ * @world  : the current world
+ * @chunk  : empty chunk
+ * @return : false if the file doesn't have it
+ *
+ * Tiles and entities are built straight from the mapped slot, no copy of
+ * the file is ever made.
+ */
+static
+bool
+W_ReadChunk(struct WorldState *world, struct WorldChunk *chunk)
+{
+    struct WorldFile *file = &world->file;
+    if (file->base == NULL)
+        return false;
+
+    struct WorldFileChunk *slot = W_FileFind(file, chunk->x, chunk->y, false);
+    if (slot == NULL)
+        return false;
+
+    Z_CopySize(chunk->tiles, slot->tiles, sizeof(chunk->tiles));
+    for (u32 chain = 0; chain < file->header->slot_count; chain++) {
+        for (u32 i = 0; i < MIN(slot->count, W_FILE_ENTITIES); i++) {
+            struct WorldFileEntity *in = &slot->entities[i];
+            if (in->arch >= Arch_COUNT || in->arch == ARCH_PLAYER)
+                continue;
+
+            struct EntityRow row = {
+                .pos        = in->pos,
+                .vel        = in->vel,
+                .rad        = in->rad,
+                .animation  = in->animation,
+                .render_off = in->render_off,
+                .render_dt  = in->render_dt,
+                .wander     = in->wander,
+            };
+            E_AddEntity(world, chunk, in->arch, &row);
         }
-        
-        result = result->next;
+        if (slot->next == 0 || slot->next > file->header->slot_count)
+            break;
+        slot = W_FileSlot(file, slot->next);
     }
+    chunk->dirty = false;
+
+    return true;
+}
+
+/**
+ * Ask the kernel to start reading in the file slots of chunks around a
+ * centre that aren't loaded yet
+ *
+ * @world  : the current world
+ * @x      : centre x coordinate
+ * @y      : centre y coordinate
+ * @radius : chebyshev radius to cover
+ */
+static
+void
+W_PrefetchChunks(struct WorldState *world, u32 x, u32 y, u32 radius)
+{
+    struct WorldFile *file = &world->file;
+    if (file->base == NULL)
+        return;
+
+    for (i64 dy = -(i64)radius; dy <= (i64)radius; dy++) {
+        for (i64 dx = -(i64)radius; dx <= (i64)radius; dx++) {
+            if (W_GetChunk(world, x + dx, y + dy, false) != NULL)
+                continue;
 
-    return NULL;
+            struct WorldFileChunk *slot = W_FileFind(file, x + dx, y + dy, false);
+            if (slot != NULL)
+                madvise(slot, W_FileSlotSize(), MADV_WILLNEED);
+        }
+    }
 }
 
 /**
- * Add an entity to a chunk
+ * Flush written slots to disk every W_FILE_FLUSH_MS, or when woken
  *
- * @chunk  : what to add to
- * @ent    : entity to add
- * @return : 0 on success, else error val if there is one
+ * @data : the world file
  */
+static
 int
-W_ChunkAddEntity(struct WorldChunk *chunk, struct Entity *ent)
+W_FileWriter(void *data)
+{
+    struct WorldFile *file = data;
+    while (!SDL_AtomicGet(&file->quit)) {
+        SDL_SemWaitTimeout(file->wake, W_FILE_FLUSH_MS);
+        W_FileFlush(file);
+    }
+    return 0;
+}
+
+/**
+ * Start the thread flushing the world file, does nothing if there's no
+ * file or it's already running
+ *
+ * @world : the current world
+ */
+void
+W_StartWriter(struct WorldState *world)
 {
-    if (!chunk)
-        return 1;
-    if (!ent)
-        return 2;
+    struct WorldFile *file = &world->file;
+    if (file->base == NULL || file->writer != NULL)
+        return;
 
-    if (chunk->head == NULL) {
-        chunk->head = ent;
-        chunk->tail = ent;
+    SDL_AtomicSet(&file->quit, 0);
+    file->wake   = SDL_CreateSemaphore(0);
+    file->writer = SDL_CreateThread(W_FileWriter, "writer", file);
+    if (file->writer == NULL) {
+        fprintf(stderr, "Can't start the world file writer: %s\n", SDL_GetError());
+        SDL_DestroySemaphore(file->wake);
+        file->wake = NULL;
     }
-    else {
-        chunk->tail->next = ent;
+}
+
+/**
+ * Stop the world file's writer and flush whatever it hadn't, must be
+ * called before the library is unloaded
+ *
+ * @world : the current world
+ */
+void
+W_StopWriter(struct WorldState *world)
+{
+    struct WorldFile *file = &world->file;
+    if (file->writer != NULL) {
+        SDL_AtomicSet(&file->quit, 1);
+        SDL_SemPost(file->wake);
+        SDL_WaitThread(file->writer, NULL);
+        SDL_DestroySemaphore(file->wake);
+        file->writer = NULL;
+        file->wake   = NULL;
     }
 
-    /* we're adding to the end, so this should be NULL */
-    ent->next = NULL;
-    ent->prev = chunk->tail;
-    chunk->tail = ent;
+    if (file->base != NULL)
+        W_FileFlush(file);
+}
 
-    return 0;
+/**
+ * Write back every changed chunk and unmap the world file
+ *
+ * @world : the current world
+ */
+void
+W_CloseWorldFile(struct WorldState *world)
+{
+    struct WorldFile *file = &world->file;
+    if (file->base == NULL)
+        return;
+
+    struct ChunkTable *table = &world->table;
+    for (u32 i = 0; i < table->capacity; i++) {
+        if (table->slots[i].chunk != NULL && !W_SaveChunk(world, table->slots[i].chunk))
+            fprintf(stderr, "Chunk %u,%u didn't fit in the world file\n",
+                    table->slots[i].chunk->x, table->slots[i].chunk->y);
+    }
+
+    W_StopWriter(world);
+    munmap(file->base, file->size);
+    close(file->fd);
+    file->base = NULL;
 }
 
 /**
- * Remove an entity from achunk
+ * Fill a freshly created chunk with its tiles and npcs
  *
- * @chunk  : the chunk to remove from
- * @ent    : entity to remove
- * @return : 0 on success, else some error value
+ * @world : the current world
+ * @chunk : empty chunk to generate
+ *
+ * The two starting rooms are hand made, everything else is scattered
+ * pillars seeded from the chunk coordinates, so a chunk comes back the
+ * same every time it's generated. Chunks on the world edge get a wall on
+ * that side since there's nothing past it.
  */
-int
-W_ChunkRemoveEntity(struct WorldChunk *chunk, struct Entity *ent)
+static
+void
+W_GenerateChunk(struct WorldState *world, struct WorldChunk *chunk)
 {
-    if (!chunk)
-        return 1;
-    if (!ent)
-        return 2;
+    u8 (*tiles)[W_CHUNK_DIM] = (u8 (*)[W_CHUNK_DIM])chunk->tiles;
 
-    if (ent == chunk->head)
-        chunk->head = ent->next;
-    if (ent == chunk->tail)
-        chunk->tail = ent->prev;
+    if (chunk->x == 1 && chunk->y == 1) {
+        for (int i = 0; i < W_CHUNK_DIM; i++)
+            for (int j = 0; j < W_CHUNK_DIM; j++)
+                if (j == 0 || j == W_CHUNK_DIM - 1 || i == 0 || (i == (W_CHUNK_DIM - 1) && j != 5))
+                    tiles[i][j] = W_TILE_WALL;
+    } else if (chunk->x == 1 && chunk->y == 2) {
+        for (int i = 0; i < W_CHUNK_DIM; i++)
+            for (int j = 0; j < W_CHUNK_DIM; j++)
+                if (j == 0 || (j == W_CHUNK_DIM - 1 && i != 5) || i == W_CHUNK_DIM - 1)
+                    tiles[i][j] = W_TILE_WALL;
+    } else {
+        u32 seed = W_HashChunk(chunk->x, chunk->y);
+        for (int n = 0; n < W_PILLARS; n++) {
+            seed = seed * 1664525u + 1013904223u;
+            int i = 1 + (seed >> 8) % (W_CHUNK_DIM - 2);
+            int j = 1 + (seed >> 20) % (W_CHUNK_DIM - 2);
+            tiles[i][j] = W_TILE_WALL;
+        }
+        for (int k = 0; k < W_CHUNK_DIM; k++) {
+            if (chunk->x == 1)
+                tiles[k][0] = W_TILE_WALL;
+            if (chunk->y == 1)
+                tiles[0][k] = W_TILE_WALL;
+        }
 
-    if (ent->prev)
-        ent->prev->next = ent->next;
-    if (ent->next)
-        ent->next->prev = ent->prev;
+        u32 npcs = seed % (W_NPCS + 1);
+        for (u32 n = 0; n < npcs; n++) {
+            seed = seed * 1664525u + 1013904223u;
+            int i = 1 + (seed >> 8) % (W_CHUNK_DIM - 2);
+            int j = 1 + (seed >> 20) % (W_CHUNK_DIM - 2);
+            if (tiles[i][j] != W_TILE_FLOOR)
+                continue;
 
-    return 0;
+            struct EntityRow npc = {
+                .pos        = { (r32)j + 0.5f, (r32)i + 0.5f },
+                .rad        = { 0.35f, 0.2f },
+                .animation  = CHARACTER_STAND0,
+                .render_off = { -0.5f, -1.5f },
+                .wander     = seed,
+            };
+            E_AddEntity(world, chunk, ARCH_NPC, &npc);
+        }
+    }
+
+    /* not in the world file yet */
+    chunk->dirty = true;
+}
+
+/**
+ * Get a chunk, reading it from the world file or generating it first if
+ * it isn't loaded
+ *
+ * @world  : the current world
+ * @x      : x coordinate
+ * @y      : y coordinate
+ * @return : the chunk, NULL only for coordinates outside the world
+ */
+struct WorldChunk *
+W_LoadChunk(struct WorldState *world, u32 x, u32 y)
+{
+    struct WorldChunk *result = W_GetChunk(world, x, y, false);
+    if (result == NULL) {
+        result = W_GetChunk(world, x, y, true);
+        if (result != NULL && !W_ReadChunk(world, result))
+            W_GenerateChunk(world, result);
+    }
+    return result;
+}
+
+/**
+ * Get the chebyshev distance between chunk coordinates
+ */
+static inline
+u32
+W_ChunkDistance(u32 ax, u32 ay, u32 bx, u32 by)
+{
+    u32 dx = (ax > bx) ? ax - bx : bx - ax;
+    u32 dy = (ay > by) ? ay - by : by - ay;
+    return MAX(dx, dy);
+}
+
+/**
+ * Keep the chunks around a centre chunk loaded and evict far away ones
+ *
+ * @world  : the current world
+ * @centre : chunk the window follows, usually the player's
+ *
+ * Missing chunks within the resident radius are loaded nearest first,
+ * and chunks past the evict radius are written back and removed, unless
+ * the world file has no room for them. Without a world file nothing is
+ * evicted, there'd be nowhere to keep it. The gap between the two
+ * radii stops chunks thrashing when walking back and forth over an edge.
+ * Work is capped per tick and resumes on the next one, so crossing a
+ * boundary never does all of it at once. The cap counts chunks rather
+ * than time so replays stay deterministic.
+ */
+void
+W_UpdateResidency(struct WorldState *world, struct WorldChunk *centre)
+{
+    struct Residency *res = &world->residency;
+    if (centre->x != res->x || centre->y != res->y) {
+        res->x       = centre->x;
+        res->y       = centre->y;
+        res->pending = true;
+        res->scan    = 0;
+        W_PrefetchChunks(world, res->x, res->y, res->radius + 1);
+    }
+    if (!res->pending)
+        return;
+
+    /* generate rings outwards so the nearest chunks show up first */
+    u32 generated = 0;
+    for (u32 ring = 1; ring <= res->radius; ring++) {
+        for (i64 dy = -(i64)ring; dy <= (i64)ring; dy++) {
+            for (i64 dx = -(i64)ring; dx <= (i64)ring; dx++) {
+                if (MAX(dx, -dx) != ring && MAX(dy, -dy) != ring)
+                    continue;
+
+                u32 x = res->x + dx;
+                u32 y = res->y + dy;
+                if (W_GetChunk(world, x, y, false) != NULL || x < 1 || y < 1 || x == ~0 || y == ~0)
+                    continue;
+                if (generated == W_RESIDENCY_GENERATE)
+                    return;
+
+                W_LoadChunk(world, x, y);
+                generated++;
+            }
+        }
+    }
+
+    /* sweep part of the table for chunks that are too far away, erasing *
+     * shifts the next entry into this slot so only step past kept ones  */
+    struct ChunkTable *table = &world->table;
+    if (world->file.base == NULL)
+        res->scan = table->capacity;
+    for (u32 scanned = 0; res->scan < table->capacity; scanned++) {
+        if (scanned == W_RESIDENCY_SCAN)
+            return;
+
+        struct WorldChunk *chunk = table->slots[res->scan].chunk;
+        if (chunk != NULL && W_ChunkDistance(chunk->x, chunk->y, res->x, res->y) > res->evict_radius &&
+            W_SaveChunk(world, chunk)) {
+            W_RemoveChunk(world, chunk->x, chunk->y);
+        } else {
+            res->scan++;
+        }
+    }
+
+    res->pending = false;
+}
+
+/**
+ * Have a sleeping npc woken when it next changes direction
+ *
+ * @world : the current world
+ * @ref   : the npc
+ *
+ * The bucket for that tick only comes round once before it is due, and
+ * its handle is simply skipped if the npc is gone by then.
+ */
+static
+void
+W_ScheduleWake(struct WorldState *world, struct EntityRef *ref)
+{
+    struct EntityTable *table = E_TABLE(ref);
+    u32 id = table->id[ref->row];
+    struct WakeBucket *bucket = &world->wake[(W_WANDER_TICKS - table->wander[ref->row] % W_WANDER_TICKS) %
+                                             W_WANDER_TICKS];
+
+    if (bucket->count == bucket->capacity) {
+        u32 capacity = MAX(bucket->capacity * 2, W_ROWS_MIN);
+        struct EntityHandle *handles = W_AllocColumn(world, capacity * sizeof(struct EntityHandle));
+        if (bucket->handles != NULL) {
+            Z_CopySize(handles, bucket->handles, bucket->count * sizeof(struct EntityHandle));
+            W_FreeColumn(world, bucket->handles, bucket->capacity * sizeof(struct EntityHandle));
+        }
+        bucket->handles  = handles;
+        bucket->capacity = capacity;
+    }
+
+    bucket->handles[bucket->count++] = (struct EntityHandle){ id, world->slots[id].generation };
+}
+
+/* a phase of chunks far enough apart to move side by side */
+struct WanderJob {
+    struct WorldState   *world;
+    struct WorldChunk  **chunks;
+    u32                 *first;   /* each chunk's first entry in bumped */
+    struct EntityHandle *bumped;  /* one per awake npc, woken after the phase */
+};
+
+/**
+ * Move the awake npcs of some chunks of a phase
+ *
+ * @data  : the phase's struct WanderJob
+ * @start : first chunk
+ * @end   : one past the last chunk
+ *
+ * Only writes to the chunks given, reading at most one chunk around them.
+ */
+static
+void
+W_WanderChunks(void *data, u32 start, u32 end)
+{
+    static const struct Vec2 directions[] = {
+        {  1.0f,  0.0f }, {  0.7071f,  0.7071f }, {  0.0f,  1.0f }, { -0.7071f,  0.7071f },
+        { -1.0f,  0.0f }, { -0.7071f, -0.7071f }, {  0.0f, -1.0f }, {  0.7071f, -0.7071f },
+    };
+
+    struct WanderJob *job = data;
+    struct WorldState *world = job->world;
+    for (u32 c = start; c < end; c++) {
+        struct WorldChunk *chunk = job->chunks[c];
+        struct EntityHandle *bumped = job->bumped + job->first[c];
+
+        for (u32 n = 0; n < chunk->active.count; n++) {
+            struct EntitySlot *slot = &world->slots[chunk->active.ids[n]];
+            struct EntityRef ref = { chunk, slot->arch, slot->row };
+            struct EntityTable *table = E_TABLE(&ref);
+
+            /* pick a new direction now and then, one in nine stands still, *
+             * unless it's following a path                                 */
+            u32 dir;
+            if (!N_Steer(world, &ref, &dir)) {
+                u32 *wander = &table->wander[ref.row];
+                if ((world->tick + *wander) % W_WANDER_TICKS == 0)
+                    *wander = *wander * 1664525u + 1013904223u;
+                dir = (*wander >> 16) % 9;
+            }
+
+            struct Vec2 acc = { 0.0f, 0.0f };
+            if (dir < 8)
+                acc = V2_Mul(W_WANDER_ACC, directions[dir]);
+
+            Move(world, &ref, acc, &bumped[n]);
+        }
+        chunk->dirty = true;
+    }
+}
+
+/**
+ * Advance every awake npc by a tick
+ *
+ * @world : the current world
+ *
+ * Npcs that stand still fall asleep until their next change of direction
+ * or until something bumps into them, so the cost follows how many npcs
+ * are doing something rather than how many are loaded.
+ *
+ * Chunks are moved in W_PHASES phases by their coordinates modulo three,
+ * so chunks in a phase are at least three apart and are spread over the
+ * job threads. Waking bumped npcs and changing chunk is left to serial
+ * passes after each phase and after all of them, and the phases always
+ * run in the same order, so the result doesn't depend on the threads.
+ *
+ * Everything moves first and changes chunk after, so an npc crossing into
+ * a chunk that hasn't been visited yet isn't moved twice. Npcs never load
+ * chunks, they stop at the edge of the loaded ones instead, so the chunk
+ * table stays put while it's walked.
+ */
+void
+W_UpdateEntities(struct WorldState *world)
+{
+    world->tick++;
+
+    /* wake whoever is due to pick a new direction */
+    struct WakeBucket *bucket = &world->wake[world->tick % W_WANDER_TICKS];
+    for (u32 i = 0; i < bucket->count; i++) {
+        struct EntityRef ref;
+        if (E_GetEntity(world, bucket->handles[i], &ref))
+            E_SetAwake(world, &ref, true);
+    }
+    bucket->count = 0;
+
+    N_UpdatePaths(world);
+
+    struct Stack *scratch = Z_ScratchStack();
+    struct LocalStack lstack;
+    Z_BeginLocalStack(&lstack, scratch);
+
+    /* sort the chunks with anyone awake into phases */
+    struct ChunkTable *chunks = &world->table;
+    struct WorldChunk **phases[W_PHASES];
+    u32 counts[W_PHASES] = { 0 };
+    for (int p = 0; p < W_PHASES; p++)
+        phases[p] = Z_PushArrayAligned(scratch, struct WorldChunk *, chunks->count,
+                                       _Alignof(struct WorldChunk *), MEM_WORLD, false);
+
+    for (u32 i = 0; i < chunks->capacity; i++) {
+        struct WorldChunk *chunk = chunks->slots[i].chunk;
+        if (chunk == NULL || chunk->active.count == 0)
+            continue;
+
+        int p = (chunk->x % 3) + 3 * (chunk->y % 3);
+        phases[p][counts[p]++] = chunk;
+    }
+
+    for (int p = 0; p < W_PHASES; p++) {
+        if (counts[p] == 0)
+            continue;
+
+        struct LocalStack phase_stack;
+        Z_BeginLocalStack(&phase_stack, scratch);
+
+        struct WanderJob job = { world, phases[p] };
+        job.first = Z_PushArrayAligned(scratch, u32, counts[p], _Alignof(u32), MEM_WORLD, false);
+        u32 moves = 0;
+        for (u32 c = 0; c < counts[p]; c++) {
+            job.first[c] = moves;
+            moves += phases[p][c]->active.count;
+        }
+        job.bumped = Z_PushArrayAligned(scratch, struct EntityHandle, moves,
+                                        _Alignof(struct EntityHandle), MEM_WORLD, false);
+
+        /* hand each thread about W_JOB_MOVES moves at a time */
+        if (moves < W_JOB_MOVES)
+            W_WanderChunks(&job, 0, counts[p]);
+        else
+            J_ParallelFor(counts[p], MAX(1, W_JOB_MOVES * counts[p] / moves), W_WanderChunks, &job);
+
+        /* whatever got bumped into gets a chance to react */
+        for (u32 n = 0; n < moves; n++) {
+            struct EntityRef ref;
+            if (E_GetEntity(world, job.bumped[n], &ref))
+                E_SetAwake(world, &ref, true);
+        }
+
+        Z_EndLocalStack(&phase_stack);
+    }
+
+    Z_EndLocalStack(&lstack);
+
+    /* go backwards, leaving moves the last entry into the current one */
+    for (u32 i = 0; i < chunks->capacity; i++) {
+        struct WorldChunk *chunk = chunks->slots[i].chunk;
+        if (chunk == NULL)
+            continue;
+
+        for (u32 n = chunk->active.count; n-- > 0;) {
+            struct EntitySlot *slot = &world->slots[chunk->active.ids[n]];
+            struct EntityRef ref = { chunk, slot->arch, slot->row };
+            E_FixChunk(world, &ref, false);
+
+            /* standing and nearly stopped, sleep until the next change */
+            struct EntityTable *table = E_TABLE(&ref);
+            u32 wander = table->wander[ref.row];
+#if defined(FIXED_POINT)
+            bool slow = FV2_SqLen(FV2_FromV2(table->vel[ref.row])) <
+                        (i64)FX_CONST(W_SLEEP_SPEED) * FX_CONST(W_SLEEP_SPEED);
+#else
+            bool slow = V2_SqLen(table->vel[ref.row]) < W_SLEEP_SPEED * W_SLEEP_SPEED;
+#endif
+            if ((wander >> 16) % 9 == 8 && slow && slot->nav == 0) {
+                table->vel[ref.row] = (struct Vec2){ 0.0f, 0.0f };
+                W_ScheduleWake(world, &ref);
+                E_SetAwake(world, &ref, false);
+            }
+        }
+    }
 }
 
 /**
@@ -111,6 +1386,7 @@ W_ChunkRemoveEntity(struct WorldChunk *chunk, struct Entity *ent)
  * @world  : world containing chunks
  * @chunk  : original chunk
  * @pos    : the new position
+ * @create : generate the chunk moved into if it isn't loaded
  * @return : the proper chunk
  */
 struct WorldChunk *
@@ -128,7 +1404,9 @@ W_FixChunkCreate(struct WorldState *world, struct WorldChunk *chunk, struct Vec2
     }
 
     if (world_e[0] != chunk->x || world_e[1] != chunk->y) {
-        return W_GetChunk(world, world_e[0], world_e[1], create);
+        if (create)
+            return W_LoadChunk(world, world_e[0], world_e[1]);
+        return W_GetChunk(world, world_e[0], world_e[1], false);
     }
     return chunk;
 }
@@ -140,68 +1418,31 @@ W_FixChunkCreate(struct WorldState *world, struct WorldChunk *chunk, struct Vec2
  * @world : the world containing chunks
  * @chunk : the original chunk
  * @pos   : position that may be off
+ *
+ * The residency window normally has the chunk loaded already, if it
+ * hasn't caught up yet the chunk is generated on the spot.
  */
 struct WorldChunk *
 W_FixChunk(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 *pos)
 {
-    return W_FixChunkCreate(world, chunk, pos, false);
+    return W_FixChunkCreate(world, chunk, pos, true);
 }
 
 /**
  * Generate a world for the given state
  *
  * @state : game state struct where we add the world
+ *
+ * Only the starting rooms are made here, the residency window fills in
+ * the rest around the player over the first few ticks.
  */
 void
 W_GenerateWorld(struct GameState *state)
 {
-    struct WorldChunk *chunk = W_GetChunk(state->world, 1, 1, true);
-
-    struct LocalStack lstack;
-    Z_BeginLocalStack(&lstack, state->temp_stack);
-
-    /* ensure first is null when starting */
-    chunk->head = NULL;
-    for (int i = 0; i < W_CHUNK_DIM; i++) {
-        for (int j = 0; j < W_CHUNK_DIM; j++) {
-            if (j == 0 || j == W_CHUNK_DIM - 1 || i == 0 || (i == (W_CHUNK_DIM - 1) && j != 5)) {
-                state->ents[state->num_ents] = (struct Entity) { .chunk = chunk,
-                                                                 .pos.x = (r32)j + 0.5f,
-                                                                 .pos.y = (r32)i + 0.5f,
-                                                                 .vel = (struct Vec2){ 0.0f, 0.0f },
-                                                                 .rad = (struct Vec2){ 0.5f, 0.5f },
-                                                                 .tl_point = (struct Vec2){ 0.0f, 0.0f },
-                                                                 .br_point = (struct Vec2){ 0.0f, 0.0f },
-                                                                 .animation = TILE_WALL_STAND0,
-                                                                 .render_off = (struct Vec2){ -0.5f, -1.5f } };
-
-                W_ChunkAddEntity(chunk, &state->ents[state->num_ents]);
-
-                state->num_ents++;
-            }
-        }
-    }
-    chunk = W_GetChunk(state->world, 1, 2, true);
-    chunk->head = NULL;
-    for (int i = 0; i < W_CHUNK_DIM; i++) {
-        for (int j = 0; j < W_CHUNK_DIM; j++) {
-            if (j == 0 || j == W_CHUNK_DIM - 1 || i == W_CHUNK_DIM - 1 ) {
-                state->ents[state->num_ents] = (struct Entity) { .chunk = chunk,
-                                                                 .pos.x = (r32)j + 0.5f,
-                                                                 .pos.y = (r32)i + 0.5f,
-                                                                 .vel = (struct Vec2){ 0.0f, 0.0f },
-                                                                 .rad = (struct Vec2){ 0.5f, 0.5f },
-                                                                 .tl_point = (struct Vec2){ 0.0f, 0.0f },
-                                                                 .br_point = (struct Vec2){ 0.0f, 0.0f },
-                                                                 .animation = TILE_WALL_STAND0,
-                                                                 .render_off = (struct Vec2){ -0.5f, -1.5f } };
-
-                W_ChunkAddEntity(chunk, &state->ents[state->num_ents]);
-
-                state->num_ents++;
-            }
-        }
-    }
+    struct Residency *res = &state->world->residency;
+    res->radius       = W_RESIDENT_RADIUS;
+    res->evict_radius = W_EVICT_RADIUS;
 
-    Z_EndLocalStack(&lstack);
+    W_LoadChunk(state->world, 1, 1);
+    W_LoadChunk(state->world, 1, 2);
 }
@@ -1,33 +1,228 @@
 #ifndef _WORLD_h_
 #define _WORLD_h_
 
+#include <SDL2/SDL.h>
+
 #include "config.h"
 #include "math.h"
 #include "memory.h"
+#include "render_config.h"
+#include "entity.h"
+#include "nav.h"
+#include "anim.h"
 
-struct Entity;
 struct GameState;
 
 #define W_CHUNK_DIM (11)
 
+/* static geometry, one per tile of a chunk */
+enum TileId {
+    W_TILE_FLOOR,
+    W_TILE_WALL,
+    Tile_COUNT
+};
+
+/* what every tile of a kind shares */
+struct TileInfo {
+    bool solid;
+    bool drawn;
+    enum AnimationId animation;
+    struct Vec2 render_off; /* from the tile centre to top left */
+};
+
+extern struct TileInfo W_TILES[Tile_COUNT];
+
 struct WorldChunk {
     u32 x, y;
-    struct WorldChunk *next;
+    bool dirty; /* changed since it was last written to the world file */
+    u32 version; /* new every time its tiles change, never 0 */
 
-    struct Entity *head;
-    struct Entity *tail;
+    u8 tiles[W_CHUNK_DIM * W_CHUNK_DIM]; /* enum TileId, row by row */
+
+    struct EntityTable tables[Arch_COUNT];
+    struct SweepList   sweep;  /* broadphase over every table */
+    struct ActiveSet   active; /* wanderers that are awake */
+    struct NavChunk    nav;    /* portals for pathfinding */
 };
 
-#define WORLD_HASHSIZE (2048)
+/* open addressing slot, empty when chunk is NULL */
+struct ChunkSlot {
+    u32 x, y;
+    struct WorldChunk *chunk;
+};
+
+/* robin hood hash of chunk coordinates, capacity is a power of two */
+struct ChunkTable {
+    struct ChunkSlot *slots;
+    u32 capacity;
+    u32 count;
+};
+
+struct ChunkTableStats {
+    u32 count;
+    u32 capacity;
+    r32 mean_probe; /* average distance from home slot */
+    u32 max_probe;
+};
+
+#define W_TABLE_MIN   (256)
+#define W_CHUNK_SLAB  (64)
+#define W_PILLARS     (8)
+
+/* entity table columns come from power of two size classes */
+#define W_COLUMN_MIN     (64)
+#define W_COLUMN_CLASSES (16)
+#define W_COLUMN_SLAB    KILOBYTES(16) /* bytes carved at a time per class */
+#define W_ROWS_MIN       (16)
+#define W_SLOTS_MIN      (256)  /* entity handle slots to start with */
+
+/* npcs per generated chunk, and how they wander about */
+#define W_NPCS         (3)
+#define W_WANDER_TICKS (64)   /* ticks between changes of direction */
+#define W_WANDER_ACC   (8.0f)
+#define W_SLEEP_SPEED  (0.1f)  /* standing npcs slower than this fall asleep */
+#define W_PHASES       (9)     /* chunks moved together are three apart */
+#define W_JOB_MOVES    (256)   /* npc moves per job when spread over threads */
+
+/* sleeping npcs waiting for their next change of direction, by tick */
+struct WakeBucket {
+    u32                  count;
+    u32                  capacity;
+    struct EntityHandle *handles;   /* may be stale or already awake */
+};
+
+/* chunks kept loaded around the player, and the budget to do so per tick */
+#define W_RESIDENT_RADIUS    (2)
+#define W_EVICT_RADIUS       (4)
+#define W_RESIDENCY_GENERATE (2)   /* chunks generated per tick */
+#define W_RESIDENCY_SCAN     (256) /* table slots checked for eviction per tick */
+
+struct Residency {
+    u32 x, y;         /* centre the window is following */
+    u32 radius;       /* generate within this many chunks */
+    u32 evict_radius; /* evict past this many chunks */
+
+    bool pending;     /* work left over from an earlier tick */
+    u32  scan;        /* next table slot to check for eviction */
+};
+
+/* world file layout: a header page, then fixed size slots holding chunks  *
+ * and a run of them holding the index. The file doubles as it fills, and   *
+ * the mapping reserves room for the biggest it can get so it never moves   */
+#define W_FILE_MAGIC    (0x36444c57) /* "WLD6" */
+#define W_FILE_INDEX    (1 << 16)    /* index entries to start with, power of two */
+#define W_FILE_SLOTS    (1 << 12)    /* slots to start with */
+#define W_FILE_RESERVE  GIGABYTES(64ull)
+#define W_FILE_ENTITIES (128)        /* entities per slot, more go in chained slots */
+#define W_FILE_PAGE     (4096)
+#define W_FILE_FLUSH_MS (1000)       /* longest a written slot waits to reach the disk */
+
+struct WorldFileHeader {
+    u32 magic;
+    u32 chunk_dim;
+    u32 slot_size;
+    u32 slot_capacity;  /* slots the file is sized for */
+    u32 slot_count;     /* slots handed out so far, freed ones included */
+    u32 free_slot;      /* first freed slot + 1, 0 when there are none */
+    u32 free_count;
+    u32 index_slot;     /* first slot of the index + 1 */
+    u32 index_capacity;
+    u32 chunk_count;    /* index entries in use */
+};
+
+/* linear probed index entry, empty when slot is 0 */
+struct WorldFileIndex {
+    u32 x, y;
+    u32 slot;           /* slot number + 1 */
+};
+
+/* what's kept of an entity, its handle slot is handed out again on load */
+struct WorldFileEntity {
+    u32         arch;
+    struct Vec2 pos;
+    struct Vec2 vel;
+    struct Vec2 rad;
+    u32         animation;
+    struct Vec2 render_off;
+    u32         render_dt;
+    u32         wander;
+};
+
+struct WorldFileChunk {
+    u32 x, y;
+    u8  tiles[W_CHUNK_DIM * W_CHUNK_DIM];
+    u32 count;          /* entities in this slot */
+    u32 next;           /* slot number + 1 of the entities that didn't fit, 0 for none, *
+                         * or of the next free slot once it's freed                     */
+    struct WorldFileEntity entities[W_FILE_ENTITIES];
+};
+
+struct WorldFile {
+    int fd;
+    u8 *base;           /* NULL when the world isn't backed by a file */
+    size_t size;        /* address space mapped, the file only covers its slots */
+
+    struct WorldFileHeader *header;
+    struct WorldFileIndex  *index;
+    u8                     *slots;
+    bool                    full;   /* couldn't grow, only said once */
+
+    /* flushes written slots to disk off the main thread */
+    SDL_Thread  *writer;
+    SDL_sem     *wake;
+    SDL_SpinLock dirty_lock;
+    bool         dirty_header;  /* header changed since the last flush */
+    size_t       dirty_lo;      /* bytes into the slots changed since the last flush */
+    size_t       dirty_hi;
+    SDL_atomic_t quit;
+};
 
 struct WorldState {
-    struct WorldChunk chunks[WORLD_HASHSIZE];
+    struct ChunkTable table;
+    struct Residency residency;
+    struct WorldFile file;
     struct Stack *stack;
+
+    /* chunks and entity columns are recycled through these */
+    struct Pool chunk_pool;
+    struct Pool column_pools[W_COLUMN_CLASSES];
+
+    /* handle slots, grown like the chunk table */
+    struct EntitySlot *slots;
+    u32 slot_capacity;
+    u32 slot_count;   /* slots ever handed out */
+    u32 free_slots;   /* first free slot + 1, 0 when there are none */
+
+    u32 versions;     /* hands out WorldChunk versions */
+    u32 entity_count;
+    u32 awake_count;
+    u64 tick;
+
+    struct WakeBucket wake[W_WANDER_TICKS];
+    struct NavState nav;
+    struct AnimWheel anim;
 };
 
+void                W_InitWorld(struct WorldState *world, struct Stack *stack);
+bool                W_OpenWorldFile(struct WorldState *world, const char *path);
+void                W_CloseWorldFile(struct WorldState *world);
+void                W_StartWriter(struct WorldState *world);
+void                W_StopWriter(struct WorldState *world);
 struct WorldChunk * W_GetChunk(struct WorldState *world, u32 x, u32 y, bool create);
-int                 W_ChunkAddEntity(struct WorldChunk *chunk, struct Entity *ent);
-int                 W_ChunkRemoveEntity(struct WorldChunk *chunk, struct Entity *ent);
+struct WorldChunk * W_LoadChunk(struct WorldState *world, u32 x, u32 y);
+void                W_UpdateResidency(struct WorldState *world, struct WorldChunk *centre);
+void                W_RemoveChunk(struct WorldState *world, u32 x, u32 y);
+void                W_ChunkTableStats(struct WorldState *world, struct ChunkTableStats *stats);
+void                W_TableReserve(struct WorldState *world);
+void                W_TableInsert(struct ChunkTable *table, struct ChunkSlot entry);
+u32                 W_TableFind(struct ChunkTable *table, u32 x, u32 y);
+void                W_TableErase(struct ChunkTable *table, u32 index);
+u8                  W_GetTile(struct WorldState *world, struct WorldChunk *chunk, i32 x, i32 y);
+void                W_SetTile(struct WorldState *world, struct WorldChunk *chunk, i32 x, i32 y, u8 tile);
+void *              W_AllocColumn(struct WorldState *world, size_t size);
+void                W_FreeColumn(struct WorldState *world, void *column, size_t size);
+void                W_UpdateEntities(struct WorldState *world);
+struct WorldChunk * W_FixChunkCreate(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 *pos, bool create);
 struct WorldChunk * W_FixChunk(struct WorldState *world, struct WorldChunk *chunk, struct Vec2 *pos);
 void                W_GenerateWorld(struct GameState *state);
 